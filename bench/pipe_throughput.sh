@@ -0,0 +1,41 @@
+#!/bin/sh
+# Measure GB/s through a multi-stage | chain with default and maximum-size
+# pipes. Usage: bench/pipe_throughput.sh [f25shell binary] [MB of data] [stages]
+# With BENCH_FORMAT=tsv the results are printed in bench/run.sh's format.
+set -e
+
+SHELL_BIN=${1:-./f25shell}
+SIZE_MB=${2:-1024}
+STAGES=${3:-4}
+DATA=$(mktemp "${TMPDIR:-/tmp}/f25bench.XXXXXX")
+trap 'rm -f "$DATA"' EXIT
+
+head -c "$((SIZE_MB * 1024 * 1024))" /dev/zero > "$DATA"
+
+# build "/bin/cat DATA | /bin/cat | ... > /dev/null" with STAGES stages
+chain() {
+    line="/bin/cat $DATA"
+    i=1
+    while [ "$i" -lt "$STAGES" ]; do
+        line="$line $1 /bin/cat"
+        i=$((i + 1))
+    done
+    echo "$line > /dev/null"
+}
+
+run() {
+    start=$(date +%s%N)
+    "$SHELL_BIN" -c "$1"
+    end=$(date +%s%N)
+    if [ "$BENCH_FORMAT" = tsv ]; then
+        awk -v mb="$SIZE_MB" -v ns="$((end - start))" -v mode="$2" -v stages="$STAGES" \
+            'BEGIN { printf "pipe_%s_%d\tthroughput\t%.3f\tGB/s\n", mode, stages, mb / 1024 / (ns / 1e9) }'
+        return
+    fi
+    awk -v mb="$SIZE_MB" -v ns="$((end - start))" -v mode="$2" \
+        'BEGIN { printf "%-8s %8.3f GB/s (%d MB in %.3f s)\n", mode, mb / 1024 / (ns / 1e9), mb, ns / 1e9 }'
+}
+
+[ "$BENCH_FORMAT" = tsv ] || echo "$STAGES-stage pipeline, $SIZE_MB MB"
+run "$(chain '|')" default
+run "$(chain '|+')" bigpipe
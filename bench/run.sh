@@ -0,0 +1,128 @@
+#!/bin/sh
+# Drive f25shell through scripted workloads and print one tab separated
+# result per line: bench, metric, value, unit. Usage:
+#   bench/run.sh [f25shell binary]
+# BENCH_MB (default 256) sizes the generated files, BENCH_RUNS (default
+# 1000) is the number of commands per rate measurement and BENCH_PROCS
+# (default 200) the number of background processes for numbg and killbp.
+set -e
+
+SHELL_BIN=${1:-./f25shell}
+SIZE_MB=${BENCH_MB:-256}
+RUNS=${BENCH_RUNS:-1000}
+PROCS=${BENCH_PROCS:-200}
+BENCH_DIR=$(dirname "$0")
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/f25bench.XXXXXX")
+trap 'rm -rf "$WORK"' EXIT
+
+emit() {
+    printf '%s\t%s\t%s\t%s\n' "$1" "$2" "$3" "$4"
+}
+
+# repeat LINE COUNT: append LINE to the script COUNT times
+repeat() {
+    awk -v line="$1" -v n="$2" 'BEGIN { for(i = 0; i < n; i++) print line }'
+}
+
+# timed SCRIPT: run f25shell on SCRIPT in its own session, so killbp only
+# sees the benchmark's processes, then kill whatever it left behind. The
+# elapsed time in nanoseconds is left in ELAPSED.
+timed() {
+    start=$(date +%s%N)
+    setsid -w sh -c 'echo $$ > "$1"; exec "$2" "$3"' sh "$WORK/sid" "$SHELL_BIN" "$1" > /dev/null
+    end=$(date +%s%N)
+    kill -KILL -- "-$(cat "$WORK/sid")" 2> /dev/null || true
+    ELAPSED=$((end - start))
+}
+
+# timed_min SCRIPT REPS: the fastest of REPS runs, for costs that are small
+# next to the noise of the setup they need
+timed_min() {
+    best=
+    i=0
+    while [ "$i" -lt "$2" ]; do
+        timed "$1"
+        if [ -z "$best" ] || [ "$ELAPSED" -lt "$best" ]; then best=$ELAPSED; fi
+        i=$((i + 1))
+    done
+    ELAPSED=$best
+}
+
+# rate NS COUNT: COUNT operations per second
+rate() {
+    awk -v ns="$1" -v n="$2" 'BEGIN { printf "%.1f", n / (ns / 1e9) }'
+}
+
+# per_op NS COUNT SCALE: nanoseconds per operation divided by SCALE
+per_op() {
+    awk -v ns="$1" -v n="$2" -v s="$3" 'BEGIN { printf "%.3f", ns / n / s }'
+}
+
+# gbps NS MB: throughput for MB megabytes
+gbps() {
+    awk -v ns="$1" -v mb="$2" 'BEGIN { printf "%.3f", mb / 1024 / (ns / 1e9) }'
+}
+
+printf '# bench\tmetric\tvalue\tunit\n'
+
+# plain exec: external commands through the launcher, and the same command
+# served by the in-process utility table
+repeat /bin/true "$RUNS" > "$WORK/exec.sh"
+timed "$WORK/exec.sh"
+emit exec commands_per_s "$(rate "$ELAPSED" "$RUNS")" 1/s
+repeat true "$RUNS" > "$WORK/utility.sh"
+timed "$WORK/utility.sh"
+emit utility commands_per_s "$(rate "$ELAPSED" "$RUNS")" 1/s
+
+# | chains of 2-5 stages: wall time from launch to the last stage reaped
+PIPE_RUNS=$((RUNS / 4 > 0 ? RUNS / 4 : 1))
+for stages in 2 3 4 5; do
+    line=/bin/true
+    i=1
+    while [ "$i" -lt "$stages" ]; do
+        line="$line | /bin/true"
+        i=$((i + 1))
+    done
+    repeat "$line" "$PIPE_RUNS" > "$WORK/pipe.sh"
+    timed "$WORK/pipe.sh"
+    emit "pipe_$stages" latency "$(per_op "$ELAPSED" "$PIPE_RUNS" 1000)" us
+done
+
+# file operations on generated text
+yes 'the quick brown fox jumps over the lazy dog' | head -c "$((SIZE_MB * 1024 * 1024))" > "$WORK/a.txt"
+cp "$WORK/a.txt" "$WORK/b.txt"
+
+echo "# $WORK/a.txt" > "$WORK/count.sh"
+timed "$WORK/count.sh"
+emit wordcount throughput "$(gbps "$ELAPSED" "$SIZE_MB")" GB/s
+
+echo "$WORK/a.txt + $WORK/b.txt > $WORK/out.txt" > "$WORK/concat.sh"
+timed "$WORK/concat.sh"
+emit concat throughput "$(gbps "$ELAPSED" "$((SIZE_MB * 2))")" GB/s
+rm -f "$WORK/out.txt"
+
+# ++ grows both files, so it runs on fresh copies
+cp "$WORK/a.txt" "$WORK/c.txt"
+cp "$WORK/b.txt" "$WORK/d.txt"
+echo "$WORK/c.txt ++ $WORK/d.txt" > "$WORK/append.sh"
+timed "$WORK/append.sh"
+emit append throughput "$(gbps "$ELAPSED" "$((SIZE_MB * 2))")" GB/s
+rm -f "$WORK/c.txt" "$WORK/d.txt"
+
+# numbg and killbp with many background processes: each cost is the
+# difference between scripts that do and do not run it, best of 5
+NUMBG_RUNS=$((RUNS * 100))
+repeat '/bin/sleep 60 &' "$PROCS" > "$WORK/spawn.sh"
+timed_min "$WORK/spawn.sh" 5
+spawn=$ELAPSED
+{ cat "$WORK/spawn.sh"; echo killbp; } > "$WORK/killbp.sh"
+timed_min "$WORK/killbp.sh" 5
+killbp=$ELAPSED
+{ cat "$WORK/spawn.sh"; repeat numbg "$NUMBG_RUNS"; echo killbp; } > "$WORK/numbg.sh"
+timed_min "$WORK/numbg.sh" 5
+emit numbg latency "$(per_op "$((ELAPSED - killbp))" "$NUMBG_RUNS" 1000)" us
+emit killbp latency "$(per_op "$((killbp - spawn))" 1 1000000)" ms
+emit killbp processes "$PROCS" count
+
+# | against |+ on a 4-stage /bin/cat chain
+BENCH_FORMAT=tsv sh "$BENCH_DIR/pipe_throughput.sh" "$SHELL_BIN" "$SIZE_MB" 4
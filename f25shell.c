@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -5,991 +6,3826 @@
 #include <sys/wait.h>
 #include <signal.h>
 #include <sys/types.h>
-#include <dirent.h>
 #include <ctype.h>
+#include <dirent.h>
+#include <sys/file.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <sys/sendfile.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define INPUT_BLOCK_SIZE (1 << 16)  // bytes read from stdin or a script at once
+#define ARENA_BLOCK_SIZE (1 << 16)  // smallest block the line arena allocates
+#define MAX_BG_JOBS 1024       // job table slots, power of two
+#define PATH_CACHE_SIZE 128     // resolved command slots, power of two
+#define WC_READ_SIZE (1 << 20)  // read() size when a file cannot be mapped
+#define WC_PARALLEL_MIN (64 << 20)  // files at least this big are counted on threads
+#define WC_CHUNK_MIN (8 << 20)  // smallest chunk handed to a counting thread
+#define WC_MAX_CHUNKS 256
+#define WC_MAX_THREADS 64
+#define WC_CACHE_SIZE 256       // remembered word counts, power of two
+#define WC_TAIL_SIZE 4096       // bytes before a cached end that must still match
+#define COPY_BUFFER_SIZE (1 << 20)  // userspace copy size when the kernel cannot copy
+#define COPY_CHUNK (1 << 30)        // bytes requested per in-kernel copy call
+#define COPY_ALL UINT64_MAX         // copy_data limit meaning "until end of file"
+#define TRACE_RING_SIZE 4096        // trace events kept, power of two
+#define AUDIT_RING_SIZE 1024        // audit records in flight, power of two
+#define AUDIT_MAX_STAGES 8          // pids and statuses kept per record
+#define AUDIT_TEXT_SIZE 160         // bytes of the command line kept per record
+
+// build with -DF25_TRACE=0 to compile every trace point out
+#ifndef F25_TRACE
+#define F25_TRACE 1
+#endif
+
+#ifndef P_PIDFD
+#define P_PIDFD 3                   // waitid id type for pidfds (Linux 5.4)
+#endif
+
+/* ======Line Arena====== */
+
+// Everything built for one input line (the line itself, its tokens, argv
+// arrays and parse nodes, per-pipeline scratch) is bump allocated from one
+// arena. Resetting it before the next line is O(1): blocks are kept and
+// reused in order, so a shell that has seen its longest line allocates no
+// more memory at all.
+struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct arena {
+    struct arena_block *first;
+    struct arena_block *current;
+};
+
+struct arena line_arena = { NULL, NULL };
+
+// helper to hand out size bytes, 16 byte aligned. A request that does not
+// fit moves on to the next kept block, or links in a new one big enough.
+void *arena_alloc(struct arena *arena, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    struct arena_block *block = arena->current;
+    if(block != NULL && block->size - block->used >= size) {
+        void *ptr = block->data + block->used;
+        block->used += size;
+        return ptr;
+    }
 
-#define MAX_ARGS 64
-#define MAX_INPUT_SIZE 1024
-#define MAX_COMMANDS 25
-#define MAX_PROCESSES 1024
-#define MAX_BG_JOBS 256
+    // later blocks were left over from a longer line: reuse one if it fits
+    while(block != NULL && block->next != NULL) {
+        block = block->next;
+        block->used = 0;
+        if(block->size >= size) {
+            arena->current = block;
+            block->used = size;
+            return block->data;
+        }
+    }
 
-pid_t session_processes[MAX_PROCESSES];
-int process_count;
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    struct arena_block *fresh = malloc(sizeof(*fresh) + block_size);
+    if(fresh == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    fresh->next = NULL;
+    fresh->size = block_size;
+    fresh->used = size;
+    if(block == NULL) {
+        arena->first = fresh;
+    } else {
+        block->next = fresh;
+    }
+    arena->current = fresh;
+    return fresh->data;
+}
 
-pid_t bg_jobs[MAX_BG_JOBS];
-int bg_job_count = 0;
+// helper to release everything allocated since the last reset
+void arena_reset(struct arena *arena) {
+    arena->current = arena->first;
+    if(arena->first != NULL) arena->first->used = 0;
+}
 
-/* ======Functions====== */
+/* ======Tracing====== */
+
+// Hot paths record how long they took into a fixed ring of the most recent
+// TRACE_RING_SIZE events, which the trace builtin dumps as Chrome trace
+// event JSON (chrome://tracing, Perfetto). Recording is off until
+// set -o trace and costs one branch per trace point while off.
+struct trace_event {
+    const char *name;   // static string
+    uint64_t start;     // CLOCK_MONOTONIC, ns
+    uint64_t duration;
+    long arg;           // event specific: child pid, stage count, ...
+};
+
+int opt_trace = 0;      // record trace events
+struct trace_event trace_ring[TRACE_RING_SIZE];
+uint64_t trace_head = 0;    // events recorded so far; the ring keeps the last ones
+
+#if F25_TRACE
+#define TRACE_BEGIN(t) uint64_t t = opt_trace ? trace_now() : 0
+#define TRACE_END(t, name, arg) do { if(opt_trace && (t) != 0) trace_record((name), (t), (arg)); } while(0)
+
+// helper to read the trace clock in nanoseconds
+static uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
 
-// helper to get all processes and its count
-void collect_processes(void) {
-    pid_t shell_id = getpid();
-    pid_t my_pgid = getpgid(shell_id);
-    pid_t bash_id = getppid();
-    
-    process_count = 0;
-    
-    // Reading /proc to get the process list
-    DIR *proc_dir = opendir("/proc");
-    if (!proc_dir) {
-        printf("Error opening /proc");
-        return;
+// helper to store an event that began at start and ends now
+static void trace_record(const char *name, uint64_t start, long arg) {
+    struct trace_event *ev = &trace_ring[trace_head & (TRACE_RING_SIZE - 1)];
+    ev->name = name;
+    ev->start = start;
+    ev->duration = trace_now() - start;
+    ev->arg = arg;
+    trace_head = trace_head + 1;
+}
+#else
+#define TRACE_BEGIN(t) (void)0
+#define TRACE_END(t, name, arg) (void)0
+#endif
+
+// 23. Dump the trace ring as Chrome trace JSON to stdout or a file, or
+// clear it with trace -c
+int handle_trace(char *tokens[], int num_tokens) {
+    if(num_tokens == 2 && strcmp(tokens[1], "-c") == 0) {
+        trace_head = 0;
+        return 0;
     }
-    
-    struct dirent *entry;
-    while ((entry = readdir(proc_dir)) != NULL) {
-        // Skip non-numeric entries because only PIDs are numeric
-        if (!isdigit(entry->d_name[0])) continue;
-        
-        pid_t pid = atoi(entry->d_name);
-              
-        // Check if process exists and get its process group
-        pid_t pgid = getpgid(pid);
-        if (pgid == -1) continue;
-        
-        // Only collect processes in our process group
-        if (pgid == my_pgid) {
-            if (process_count < MAX_PROCESSES) {
-                session_processes[process_count++] = pid;
-            } else {
-                printf("MAX_PROCESSES limit reached\n");
-                break;
-            }
+    int fd = STDOUT_FILENO;
+    if(num_tokens == 2) {
+        fd = open(tokens[1], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0) {
+            printf("Failed to open file %s\n", tokens[1]);
+            return 1;
         }
-    } 
-    closedir(proc_dir);
+    }
+    fflush(stdout);
+
+    int pid = (int)getpid();
+    uint64_t first = trace_head > TRACE_RING_SIZE ? trace_head - TRACE_RING_SIZE : 0;
+    dprintf(fd, "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"args\":{\"name\":\"f25shell\"}}", pid);
+    for(uint64_t i = first; i < trace_head; i++) {
+        struct trace_event *ev = &trace_ring[i & (TRACE_RING_SIZE - 1)];
+        dprintf(fd, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%" PRIu64 ".%03u,\"dur\":%" PRIu64
+                    ".%03u,\"pid\":%d,\"tid\":%d,\"args\":{\"arg\":%ld}}",
+                ev->name, ev->start / 1000, (unsigned)(ev->start % 1000),
+                ev->duration / 1000, (unsigned)(ev->duration % 1000), pid, pid, ev->arg);
+    }
+    dprintf(fd, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"recorded\":%" PRIu64
+                ",\"dropped\":%" PRIu64 "}}\n", trace_head, first);
+    if(fd != STDOUT_FILENO) close(fd);
+    return 0;
 }
 
-// 1. Kill current terminal
-void handle_killterm() {
-    pid_t pid = getpid();
-    // Terminate this process via SIGKILL to pid
-    int kill_status = kill(pid, SIGKILL);
+/* ======Path Cache====== */
+
+// command name -> absolute path, filled on first use so later launches skip
+// the $PATH walk. Slots are open addressed; removed entries leave tombstones.
+struct path_entry {
+    char name[64];
+    char path[512];
+    int hits;
+    int state;      // 0 empty, 1 used, 2 removed
+};
+
+struct path_entry path_cache[PATH_CACHE_SIZE];
+int path_cache_count = 0;
+uint64_t path_cache_env_hash = 0;   // hash of the PATH the cache was built for
+
+// helper FNV-1a hash used for cache slots and PATH change detection
+static uint64_t fnv1a(const char *str) {
+    uint64_t hash = 1469598103934665603ULL;
+    while(*str) {
+        hash = (hash ^ (unsigned char)*str++) * 1099511628211ULL;
+    }
+    return hash;
+}
 
-    // Print based on kill return value
-    if (kill_status == -1) {
-        printf("Failed to terminate f25shell\n");
-    } else {
-        printf("Current f25shell killed\n");
+// helper to forget every cached path
+void path_cache_clear(void) {
+    memset(path_cache, 0, sizeof(path_cache));
+    path_cache_count = 0;
+}
+
+// helper to drop the cache when PATH no longer matches what it was built for
+static void path_cache_check_env(void) {
+    const char *env = getenv("PATH");
+    uint64_t hash = fnv1a(env ? env : "");
+    if(hash != path_cache_env_hash) {
+        path_cache_clear();
+        path_cache_env_hash = hash;
     }
 }
 
-// 2. Kill all terminals
-int killed = 0;
-void handle_killallterms() {
+// helper to find the slot for name, or NULL if it is not cached
+static struct path_entry *path_cache_find(const char *name) {
+    size_t slot = fnv1a(name) & (PATH_CACHE_SIZE - 1);
+    for(int probe = 0; probe < PATH_CACHE_SIZE; probe++) {
+        struct path_entry *entry = &path_cache[(slot + probe) & (PATH_CACHE_SIZE - 1)];
+        if(entry->state == 0) return NULL;
+        if(entry->state == 1 && strcmp(entry->name, name) == 0) return entry;
+    }
+    return NULL;
+}
 
-    // first get all processes
-    collect_processes();
-    pid_t shell_id = getpid();
+// helper to remember a resolved path, silently skipping oversized names
+static struct path_entry *path_cache_insert(const char *name, const char *path) {
+    if(strlen(name) >= sizeof(path_cache[0].name) || strlen(path) >= sizeof(path_cache[0].path)) {
+        return NULL;
+    }
+    // keep probes short by starting over once the table is 3/4 full
+    if(path_cache_count >= PATH_CACHE_SIZE * 3 / 4) {
+        path_cache_clear();
+    }
+    size_t slot = fnv1a(name) & (PATH_CACHE_SIZE - 1);
+    while(path_cache[slot].state == 1) {
+        slot = (slot + 1) & (PATH_CACHE_SIZE - 1);
+    }
+    struct path_entry *entry = &path_cache[slot];
+    strcpy(entry->name, name);
+    strcpy(entry->path, path);
+    entry->hits = 0;
+    entry->state = 1;
+    path_cache_count = path_cache_count + 1;
+    return entry;
+}
 
-    for (int i = 0; i < process_count; i++) {
-        pid_t pid = session_processes[i];
+// helper to walk $PATH once for name, writing the first executable match to out
+static int path_search(const char *name, char *out, size_t out_size) {
+    const char *env = getenv("PATH");
+    if(env == NULL) env = "/usr/local/bin:/usr/bin:/bin";
 
-        // process list has ourselves also so skip it
-        if (pid == shell_id)    continue;
+    const char *dir = env;
+    while(1) {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
 
-        // read the executable name skip if not f25shell
-        char path[64];
-        snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+        // an empty PATH element means the current directory
+        int len;
+        if(dir_len == 0) {
+            len = snprintf(out, out_size, "%s", name);
+        } else {
+            len = snprintf(out, out_size, "%.*s/%s", (int)dir_len, dir, name);
+        }
 
-        FILE *fp = fopen(path, "r");
-        if (!fp) continue;
+        struct stat st;
+        if(len > 0 && (size_t)len < out_size && stat(out, &st) == 0
+                && S_ISREG(st.st_mode) && access(out, X_OK) == 0) {
+            return 0;
+        }
+        if(end == NULL) break;
+        dir = end + 1;
+    }
+    return -1;
+}
 
-        char name[32] = {0};
-        if (fgets(name, sizeof(name), fp)) {
-            // strip trailing newline
-            name[strcspn(name, "\n")] = '\0';
+// helper to resolve a command name to an executable path. Names containing a
+// slash are used as-is. Sets *cached when the answer came from the cache.
+const char *resolve_command(const char *name, char *out, size_t out_size, int *cached) {
+    *cached = 0;
+    if(strchr(name, '/') != NULL) return name;
+
+    path_cache_check_env();
+    struct path_entry *entry = path_cache_find(name);
+    if(entry != NULL) {
+        entry->hits = entry->hits + 1;
+        *cached = 1;
+        return entry->path;
+    }
 
-            //comparing the process name with f25shell
-            if (strcmp(name, "f25shell") == 0) {
-                if (kill(pid, SIGTERM) == 0) {
-                    printf("Killed f25shell PID %d\n", pid);
-                    killed = killed + 1;
-                } else {
-                    printf("Failed to kill f25shell PID %d\n", pid);
-                }
-            }
-        } fclose(fp);
-    } 
-    if (killed == 0)
-        printf("No other f25shell instances found.\n");
+    if(path_search(name, out, out_size) < 0) return NULL;
+    entry = path_cache_insert(name, out);
+    if(entry != NULL) {
+        entry->hits = 1;
+    }
+    return out;
 }
 
-// helper to add background job
-static void add_background_job(pid_t pid) {
-    if (bg_job_count < MAX_BG_JOBS) {
-        bg_jobs[bg_job_count++] = pid;
-    } else {
-        printf("Too many background jobs\n");
+// helper to drop one stale entry, e.g. after its binary was removed
+void path_cache_forget(const char *name) {
+    struct path_entry *entry = path_cache_find(name);
+    if(entry != NULL) {
+        entry->state = 2;
+        path_cache_count = path_cache_count - 1;
     }
 }
 
-// 3. Count bg processes
-void count_bg_processes(void) {
-    int alive = 0;  
-    // Iterate through stored background PIDs
-    for (int i = 0; i < bg_job_count; i++) {
-        // Check if process is still alive
-        if (kill(bg_jobs[i], 0) == 0) {
-            alive = alive + 1;
+/* ======Launcher====== */
+
+// stdio setup the launcher applies in the child before exec
+struct launch_io {
+    int in_fd;      // becomes stdin of the child, -1 to inherit
+    int out_fd;     // becomes stdout of the child, -1 to inherit
+};
+
+// helper to start a command without copying the shell's address space.
+// glibc runs posix_spawn on clone(CLONE_VM|CLONE_VFORK), so launch cost stays
+// flat however large the shell grows. All fds the shell hands to children are
+// O_CLOEXEC, so only the dup2 actions are needed. Returns child pid or -1.
+pid_t launch_command(char *argv[], const struct launch_io *io) {
+    TRACE_BEGIN(setup_start);
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    if(io != NULL) {
+        if(io->in_fd >= 0 && io->in_fd != STDIN_FILENO) {
+            posix_spawn_file_actions_adddup2(&actions, io->in_fd, STDIN_FILENO);
+        }
+        if(io->out_fd >= 0 && io->out_fd != STDOUT_FILENO) {
+            posix_spawn_file_actions_adddup2(&actions, io->out_fd, STDOUT_FILENO);
         }
     }
-    printf("Number of background processes in current session: %d\n", alive);
-}
 
-// 4. Kill all processes other than current and bash
-void kill_all_processes() {
-    collect_processes();
-    int processes_killed = 0;
-    pid_t bash_id = getppid();
-    pid_t current_shell_id = getpid();
+    // children start with an empty signal mask whatever the shell blocks
+    sigset_t empty_mask;
+    sigemptyset(&empty_mask);
+    posix_spawnattr_setsigmask(&attr, &empty_mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_USEVFORK);
+
+    // shell output buffered so far must land before anything the child writes
+    fflush(stdout);
+    TRACE_END(setup_start, "dup2_setup", 0);
+
+    // exec the resolved path directly; a cached path that fails to exec is
+    // dropped and looked up again once in case the binary moved
+    TRACE_BEGIN(spawn_start);
+    pid_t pid = -1;
+    int err = ENOENT;
+    for(int attempt = 0; attempt < 2; attempt++) {
+        char path_buf[PATH_MAX];
+        int cached;
+        const char *path = resolve_command(argv[0], path_buf, sizeof(path_buf), &cached);
+        if(path == NULL) break;
+
+        err = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+        if(err == ENOEXEC) {
+            // no #! line: run it as a /bin/sh script, as execvp would
+            int argc = 0;
+            while(argv[argc] != NULL) argc = argc + 1;
+            char **sh_argv = arena_alloc(&line_arena, (size_t)(argc + 2) * sizeof(*sh_argv));
+            sh_argv[0] = "/bin/sh";
+            sh_argv[1] = (char *)path;
+            memcpy(sh_argv + 2, argv + 1, (size_t)argc * sizeof(*sh_argv));
+            err = posix_spawn(&pid, "/bin/sh", &actions, &attr, sh_argv, environ);
+        }
+        if(err == 0 || !cached || err == EAGAIN || err == ENOMEM) break;
+        path_cache_forget(argv[0]);
+    }
 
-    for(int i = 0; i < process_count; i++) {
-        pid_t pid = session_processes[i];
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    // with vfork semantics this covers both the clone and the exec
+    TRACE_END(spawn_start, "fork_exec", err == 0 ? (long)pid : -1L);
 
-        // Check pid of all processes gathered is not equal to bash id or current shell id
-        if (pid != bash_id && pid != current_shell_id) {
-            if (kill(pid, SIGKILL) == 0) {
-                printf("Killed process %d\n", pid);
-                processes_killed = processes_killed + 1;
-            } else if (errno == ESRCH) {
-                // Process already dead - not an error
-                processes_killed = processes_killed + 1;  // Count as success
-            } else {
-                printf("Failed to kill process %d\n", pid);
-            }
+    if(err != 0) {
+        // spawn reports both clone and exec errors through its return value
+        if(err == EAGAIN || err == ENOMEM) {
+            printf("Fork failed\n");
+        } else {
+            printf("Exec failed for %s\n", argv[0]);
         }
+        return -1;
     }
+    return pid;
 }
 
-// 6. Word count for text file
-void file_wordcount(char *tokens[], int num_tokens) {
-    // Validate arguments
-    if(num_tokens != 2) {
-        printf("Command argc must be 2\n");
-        return;
-    }
+/* ======Job Table====== */
+
+// Background processes are kept in a table keyed by pid (open addressing),
+// so the SIGCHLD handler finds a finished job in O(1). The handler reaps
+// every exited child; foreground launches block SIGCHLD until they have
+// waited for their own pids, so it never takes one of those.
+// With bglimit set, jobs past the limit are forked but held at a gate pipe
+// (JOB_QUEUED) and the handler opens the gate of the best queued job, lowest
+// nice value first, whenever a running one exits.
+enum job_state { JOB_FREE, JOB_RUNNING, JOB_QUEUED, JOB_DONE, JOB_REMOVED };
+
+struct job {
+    pid_t pid;
+    int id;             // number shown by jobs, counts up per session
+    int state;
+    int status;         // exit status once done
+    int gate_fd;        // write end the queued job waits on, -1 once started
+    int nice;           // queue priority, the job's nice increment
+    int audit_pending;  // exit still to be written to the audit log
+    int64_t start_ns;   // CLOCK_REALTIME at launch, for the audit log
+    int64_t end_ns;     // CLOCK_REALTIME when reaped
+    uint64_t line;      // input line that started it
+    char label[64];     // command name for jobs output
+};
+
+struct job job_table[MAX_BG_JOBS];
+volatile sig_atomic_t bg_running = 0;   // jobs still running, kept live for numbg
+volatile sig_atomic_t bg_queued = 0;    // jobs waiting for a free slot
+int bg_done = 0;                        // finished jobs not yet reported
+int bg_limit = 0;                       // running jobs allowed at once, 0 for no limit
+int next_job_id = 1;
+
+// helper to tell whether a slot holds a job that has not been released
+static int job_live(const struct job *job) {
+    return job->state == JOB_RUNNING || job->state == JOB_QUEUED || job->state == JOB_DONE;
+}
 
-    // opening the file - argc 1
-    char *filename = tokens[1]; 
-    int fd = open(filename, O_RDONLY);
-    if(fd < 0) {
-        printf("Failed to open file %s\n", filename);
-        return;
+// helper to find the slot holding pid, NULL if it is not a job
+static struct job *job_find(pid_t pid) {
+    unsigned slot = (unsigned)pid & (MAX_BG_JOBS - 1);
+    for(int probe = 0; probe < MAX_BG_JOBS; probe++) {
+        struct job *job = &job_table[(slot + probe) & (MAX_BG_JOBS - 1)];
+        if(job->state == JOB_FREE) return NULL;
+        if(job->pid == pid && job_live(job)) return job;
     }
+    return NULL;
+}
 
-    // Reading the file content
-    char buffer[4096];
-    int bytes_read;
-    int word_count = 0;
-    int in_word = 0;
-
-    while((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) {
-        for(int i=0; i<bytes_read; i++) {
-            char ch = buffer[i];
-            // Check if character is whitespace
-            if(ch==' ' || ch=='\n' || ch=='\t' || ch=='\r') {
-                if(in_word) {
-                    word_count = word_count + 1;
-                    in_word = 0;
-                }
-            } else {
-                in_word = 1;
+// helper to start queued jobs while the limit allows, best first. Called
+// from the handler or with SIGCHLD blocked; write and close are
+// async-signal-safe.
+static void bg_dispatch(void) {
+    while(bg_queued > 0 && (bg_limit == 0 || bg_running < bg_limit)) {
+        struct job *best = NULL;
+        for(int i = 0; i < MAX_BG_JOBS; i++) {
+            struct job *job = &job_table[i];
+            if(job->state != JOB_QUEUED) continue;
+            if(best == NULL || job->nice < best->nice || (job->nice == best->nice && job->id < best->id)) {
+                best = job;
             }
         }
+        if(best == NULL) break;
+        ssize_t ignored = write(best->gate_fd, "", 1);
+        (void)ignored;
+        close(best->gate_fd);
+        best->gate_fd = -1;
+        best->state = JOB_RUNNING;
+        bg_queued = bg_queued - 1;
+        bg_running = bg_running + 1;
     }
-    // Count last word if file doesn't end with whitespace
-    if(in_word) {
-        word_count = word_count + 1;
-    }
-    close(fd);
-    printf("Total word count is: %d\n", word_count);
 }
 
-// 7. File concatenation
-void file_concat(char *tokens[], int num_tokens) {
-    // Count number of files
-    int file_count = 0;
-    char *files[MAX_COMMANDS];
-    
-    for(int i=0; i<num_tokens; i++) {
-        if(strcmp(tokens[i], "+") != 0) {
-            files[file_count] = tokens[i];
-            // files will be 1 more than the + operators
-            file_count = file_count + 1;
+// helper to record that a reaped pid exited; ignored if it is not a job
+static void job_finished(pid_t pid, int status) {
+    struct job *job = job_find(pid);
+    if(job != NULL && (job->state == JOB_RUNNING || job->state == JOB_QUEUED)) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        job->end_ns = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+        job->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        if(job->state == JOB_QUEUED) {
+            // killed before it got to run
+            close(job->gate_fd);
+            job->gate_fd = -1;
+            bg_queued = bg_queued - 1;
+        } else {
+            bg_running = bg_running - 1;
         }
+        job->state = JOB_DONE;
+        bg_done = bg_done + 1;
     }
+}
 
-    int plus_count = num_tokens - file_count;
-    
-    // Validate file count
-    if(file_count < 2) {
-        printf("Need at least 2 files\n");
-        return;
+// SIGCHLD handler: reap every exited child and update its job. Only
+// async-signal-safe calls and plain stores happen here.
+static void sigchld_handler(int sig) {
+    (void)sig;
+    int saved_errno = errno;
+    int status;
+    pid_t pid;
+    while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        job_finished(pid, status);
     }
+    bg_dispatch();
+    errno = saved_errno;
+}
 
-    // Check max concatenation operations
-    if(plus_count > 4) {
-        printf("Maximum 4 concatenation only\n");
-        return;
-    }
+// helper to install the SIGCHLD handler at startup
+void jobs_init(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+}
 
-    // Read and print each file
-    for(int i=0; i<file_count; i++) {
-        int fd = open(files[i], O_RDONLY);
-        if(fd < 0) {
-            printf("Failed to open file %s\n", files[i]);
-            continue;
-        }
+// helper to block SIGCHLD around a launch-and-wait section; old receives
+// the previous mask for jobs_unblock
+void jobs_block(sigset_t *old) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, old);
+}
 
-        // Read and write to stdout
-        char buffer[4096];
-        int bytes_read;
-        while((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) {
-            write(1, buffer, bytes_read);
-        }
-        close(fd);
-    }
+void jobs_unblock(const sigset_t *old) {
+    sigprocmask(SIG_SETMASK, old, NULL);
 }
 
-// 8. File append operation
-void file_append(char *tokens[], int num_tokens) {
-    if(num_tokens != 3) {
-        printf("Few/many arguments received\n");
-        return;
-    }
+// helper to free a finished slot after it has been reported
+static void job_release(struct job *job) {
+    job->state = JOB_REMOVED;
+    bg_done = bg_done - 1;
+}
 
-    // Check if middle token is ++
-    if(strcmp(tokens[1], "++") != 0) {
-        printf("Invalid format for file append\n");
-        return;
+// helper to add background job; must be called with SIGCHLD blocked so the
+// job cannot be reaped before it is in the table. A job given a gate_fd is
+// queued until bg_dispatch writes to it; nice orders the queue.
+static void add_background_job(pid_t pid, const char *label, int gate_fd, int nice) {
+    // make room by dropping finished jobs nobody asked about
+    if(bg_running + bg_queued + bg_done >= MAX_BG_JOBS * 3 / 4) {
+        for(int i = 0; i < MAX_BG_JOBS; i++) {
+            if(job_table[i].state == JOB_DONE) job_release(&job_table[i]);
+        }
     }
-
-    char *file1 = tokens[0];
-    char *file2 = tokens[2];
-
-    // Read file1 content
-    int fd1 = open(file1, O_RDONLY);
-    if(fd1 < 0) {
-        printf("Failed to open file %s\n", file1);
+    if(bg_running + bg_queued >= MAX_BG_JOBS * 3 / 4) {
+        printf("Too many background jobs, %d not tracked\n", pid);
+        if(gate_fd >= 0) close(gate_fd);    // lets a gated job see EOF and quit
         return;
     }
 
-    char buffer1[4096];
-    int bytes1 = read(fd1, buffer1, sizeof(buffer1));
-    if(bytes1 < 0) {
-        printf("Failed to read file %s\n", file1);
-        close(fd1);
-        return;
+    // a slot whose exit is not in the audit log yet is not reused either
+    unsigned slot = (unsigned)pid & (MAX_BG_JOBS - 1);
+    while(job_live(&job_table[slot]) || job_table[slot].audit_pending) {
+        slot = (slot + 1) & (MAX_BG_JOBS - 1);
     }
-    close(fd1);
-
-    // Read file2 content
-    int fd2 = open(file2, O_RDONLY);
-    if(fd2 < 0) {
-        printf("Failed to open file %s\n", file2);
-        return;
+    struct job *job = &job_table[slot];
+    job->pid = pid;
+    job->id = next_job_id++;
+    job->status = 0;
+    job->gate_fd = gate_fd;
+    job->nice = nice;
+    job->audit_pending = 0;
+    snprintf(job->label, sizeof(job->label), "%s", label);
+    if(gate_fd >= 0) {
+        job->state = JOB_QUEUED;
+        bg_queued = bg_queued + 1;
+    } else {
+        job->state = JOB_RUNNING;
+        bg_running = bg_running + 1;
     }
 
-    char buffer2[4096];
-    int bytes2 = read(fd2, buffer2, sizeof(buffer2));
-    if(bytes2 < 0) {
-        printf("Failed to read file %s\n", file2);
-        close(fd2);
-        return;
+    // tombstones are only needed while a probe chain runs through them
+    if(bg_running + bg_queued + bg_done == 1) {
+        for(int i = 0; i < MAX_BG_JOBS; i++) {
+            if(job_table[i].state == JOB_REMOVED) job_table[i].state = JOB_FREE;
+        }
     }
-    close(fd2);
+}
 
-    // Append file2 content to file1
-    int fd1_write = open(file1, O_WRONLY | O_APPEND);
-    if(fd1_write < 0) {
-        printf("Failed to open file %s for writing\n", file1);
-        return;
-    }
-    write(fd1_write, buffer2, bytes2);
-    close(fd1_write);
+// helper for sorting jobs output by job number
+static int job_compare(const void *a, const void *b) {
+    return (*(struct job *const *)a)->id - (*(struct job *const *)b)->id;
+}
 
-    // Append file1 original content to file2
-    int fd2_write = open(file2, O_WRONLY | O_APPEND);
-    if(fd2_write < 0) {
-        printf("Failed to open file %s for writing\n", file2);
-        return;
+// 3. Count bg processes, kept up to date by the SIGCHLD handler
+void count_bg_processes(void) {
+    printf("Number of background processes in current session: %d\n", (int)bg_running);
+    if(bg_limit > 0 || bg_queued > 0) {
+        printf("Queued background jobs: %d (limit %d)\n", (int)bg_queued, bg_limit);
     }
-    write(fd2_write, buffer1, bytes1);
-    close(fd2_write);
-
-    printf("Files appended successfully\n");
 }
 
-// helper function to check for file operations
-void check_file_ops(char *tokens[], int num_tokens) {
-    // Check for word count operator
-    if(strcmp(tokens[0], "#") == 0) {
-        file_wordcount(tokens, num_tokens);
-        return;
+// 25. Show the background job limit, or set it with bglimit N (0: none).
+// Raising it starts queued jobs straight away.
+int handle_bglimit(char *tokens[], int num_tokens) {
+    if(num_tokens == 1) {
+        if(bg_limit == 0) {
+            printf("Background job limit: none\n");
+        } else {
+            printf("Background job limit: %d\n", bg_limit);
+        }
+        return 0;
+    }
+    char *end;
+    long limit = strtol(tokens[1], &end, 10);
+    if(*end != '\0' || end == tokens[1] || limit < 0 || limit > MAX_BG_JOBS) {
+        printf("Usage: bglimit [N]\n");
+        return 1;
     }
+    sigset_t old;
+    jobs_block(&old);
+    bg_limit = (int)limit;
+    bg_dispatch();
+    jobs_unblock(&old);
+    return 0;
+}
 
-    // Check for file append
-    for(int i=0; i<num_tokens; i++) {
-        if(strcmp(tokens[i], "++") == 0) {
-            file_append(tokens, num_tokens);
-            return;
+// 17. List background jobs; finished ones are shown once and then dropped
+void handle_jobs(void) {
+    sigset_t old;
+    jobs_block(&old);
+    struct job *list[MAX_BG_JOBS];
+    int count = 0;
+    for(int i = 0; i < MAX_BG_JOBS; i++) {
+        if(job_live(&job_table[i])) {
+            list[count++] = &job_table[i];
         }
     }
-
-    // Check for file concatenation
-    for(int i=0; i<num_tokens; i++) {
-        if(strcmp(tokens[i], "+") == 0) {
-            file_concat(tokens, num_tokens);
-            return;
+    qsort(list, count, sizeof(list[0]), job_compare);
+    for(int i = 0; i < count; i++) {
+        struct job *job = list[i];
+        if(job->state == JOB_RUNNING) {
+            printf("[%d] %d Running %s\n", job->id, job->pid, job->label);
+        } else if(job->state == JOB_QUEUED) {
+            printf("[%d] %d Queued(nice %d) %s\n", job->id, job->pid, job->nice, job->label);
+        } else {
+            printf("[%d] %d Done(%d) %s\n", job->id, job->pid, job->status, job->label);
+            job_release(job);
         }
     }
+    jobs_unblock(&old);
 }
 
-// helper function for all redirection operations
-void handle_redirection(char *tokens[], int num_tokens, const char *operator, int flags, const char *error_msg) {
-    int redir_pos = -1;
-    
-    // Find position of operator
-    for(int i=0; i<num_tokens; i++) {
-        if(strcmp(tokens[i], operator) == 0) {
-            redir_pos = i;
-            break;
+// 18. Wait for every background job, or for one pid / %job number.
+// Returns the exit status of the job waited for (0 when waiting for all).
+int handle_wait(char *tokens[], int num_tokens) {
+    struct job *target = NULL;
+    sigset_t old;
+    jobs_block(&old);
+
+    if(num_tokens == 2) {
+        for(int i = 0; i < MAX_BG_JOBS; i++) {
+            struct job *job = &job_table[i];
+            if(!job_live(job)) continue;
+            if(tokens[1][0] == '%' ? job->id == atoi(tokens[1] + 1) : job->pid == atoi(tokens[1])) {
+                target = job;
+                break;
+            }
+        }
+        if(target == NULL) {
+            printf("wait: no such job %s\n", tokens[1]);
+            jobs_unblock(&old);
+            return 127;
         }
     }
-    
-    // Validate redirection syntax
-    if(redir_pos == -1 || redir_pos + 1 >= num_tokens) {
-        printf("%s\n", error_msg);
-        return;
+
+    // sleep until the handler marks the job(s) done
+    sigset_t wait_mask = old;
+    sigdelset(&wait_mask, SIGCHLD);
+    while(target ? target->state != JOB_DONE : bg_running + bg_queued > 0) {
+        sigsuspend(&wait_mask);
     }
-    
-    // Validate argc for command part
-    if(redir_pos < 1 || redir_pos > 5) {
-        printf("Command argc must be between 1 and 5\n");
-        return;
+
+    int status = 0;
+    if(target != NULL) {
+        status = target->status;
+        job_release(target);
     }
-    
-    // Build command array
-    char *cmd[MAX_ARGS];
-    for(int i=0; i<redir_pos; i++) {
-        cmd[i] = tokens[i];
-    }
-    cmd[redir_pos] = NULL;
-    
-    char *filename = tokens[redir_pos + 1];
-    
-    int fork_res = fork();
-    if(fork_res == 0) {
-        // Child process - setup redirection
-        int fd = open(filename, flags, 0644);
-        if(fd < 0) {
-            printf("Failed to open file %s\n", filename);
-            exit(1);
-        }
-        
-        // Redirect based on flags (input vs output)
-        if(flags == O_RDONLY) {
-            dup2(fd, STDIN_FILENO);
-        } else {
-            dup2(fd, STDOUT_FILENO);
+    jobs_unblock(&old);
+    return status;
+}
+
+/* ======Process Scanner====== */
+
+// One process as read from /proc/<pid>/stat
+struct proc_entry {
+    pid_t pid;
+    pid_t pgid;
+    char comm[16];      // kernel command name, at most 15 chars
+};
+
+// Result of the last scan; the array grows as needed and is kept between
+// scans so repeated killbp/killallterms calls do not reallocate
+struct proc_snapshot {
+    struct proc_entry *entries;
+    int count;
+    int capacity;
+};
+
+struct proc_snapshot session_procs = { NULL, 0, 0 };
+
+// getdents64 record layout (not exported by glibc headers)
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// helper to read pgid and comm from one /proc/<pid>/stat, relative to the
+// open /proc directory. Returns -1 if the process is gone.
+static int read_proc_stat(int proc_fd, const char *pid_name, struct proc_entry *entry) {
+    char path[32];
+    snprintf(path, sizeof(path), "%s/stat", pid_name);
+    int fd = openat(proc_fd, path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return -1;
+    char buf[512];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if(n <= 0) return -1;
+    buf[n] = '\0';
+
+    // "pid (comm) state ppid pgrp ...": comm may itself hold ')' or spaces
+    char *open_paren = strchr(buf, '(');
+    char *close_paren = strrchr(buf, ')');
+    if(open_paren == NULL || close_paren == NULL || close_paren < open_paren) return -1;
+    size_t comm_len = (size_t)(close_paren - open_paren - 1);
+    if(comm_len >= sizeof(entry->comm)) comm_len = sizeof(entry->comm) - 1;
+    memcpy(entry->comm, open_paren + 1, comm_len);
+    entry->comm[comm_len] = '\0';
+
+    char state;
+    int ppid, pgrp;
+    if(sscanf(close_paren + 2, "%c %d %d", &state, &ppid, &pgrp) != 3) return -1;
+    entry->pgid = pgrp;
+    return 0;
+}
+
+// helper to append one entry, growing the snapshot geometrically
+static int snapshot_add(struct proc_snapshot *snap, const struct proc_entry *entry) {
+    if(snap->count == snap->capacity) {
+        int capacity = snap->capacity ? snap->capacity * 2 : 1024;
+        struct proc_entry *grown = realloc(snap->entries, capacity * sizeof(*grown));
+        if(grown == NULL) return -1;
+        snap->entries = grown;
+        snap->capacity = capacity;
+    }
+    snap->entries[snap->count++] = *entry;
+    return 0;
+}
+
+// helper to scan /proc into snap, keeping processes in process group pgid
+// (or all of them when pgid is 0). Directory entries come from getdents64
+// in 64 KB batches and each pid costs a single stat read.
+int scan_processes(struct proc_snapshot *snap, pid_t pgid) {
+    snap->count = 0;
+    int proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(proc_fd < 0) {
+        printf("Error opening /proc\n");
+        return -1;
+    }
+
+    static char buf[1 << 16];
+    long n;
+    while((n = syscall(SYS_getdents64, proc_fd, buf, sizeof(buf))) > 0) {
+        for(long off = 0; off < n; ) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+            off += d->d_reclen;
+
+            // Skip non-numeric entries because only PIDs are numeric
+            if(!isdigit((unsigned char)d->d_name[0])) continue;
+
+            struct proc_entry entry;
+            entry.pid = atoi(d->d_name);
+            if(read_proc_stat(proc_fd, d->d_name, &entry) < 0) continue;
+            if(pgid != 0 && entry.pgid != pgid) continue;
+            if(snapshot_add(snap, &entry) < 0) {
+                printf("Out of memory while scanning /proc\n");
+                close(proc_fd);
+                return -1;
+            }
         }
-        close(fd);
-        
-        execvp(cmd[0], cmd);
-        printf("Exec failed for %s\n", cmd[0]);
-        exit(1);
-    } else if(fork_res > 0) {
-        wait(NULL);
-    } else {
-        printf("Fork failed\n");
     }
+    close(proc_fd);
+    return 0;
 }
 
-// 9. Input redirection
-void redir_in(char *tokens[], int num_tokens) {
-    handle_redirection(tokens, num_tokens, "<", O_RDONLY, "Invalid input redirection syntax");
+/* ======Instance Registry====== */
+
+// Every running f25shell owns a file named after its pid in a per-user
+// runtime directory and holds an exclusive flock on it until it exits, so
+// killallterms reads one small directory instead of scanning /proc and
+// finds shells in every process group. Files left by a shell that died
+// without cleaning up are unlocked and get removed by the next scan.
+char registry_dir[256] = "";
+char registry_path[300] = "";
+int registry_fd = -1;
+
+// helper wrapper; glibc only gained pidfd_open in 2.36
+static int open_pidfd(pid_t pid) {
+    return (int)syscall(SYS_pidfd_open, pid, 0);
 }
 
-// 10. Output redirection
-void redir_out(char *tokens[], int num_tokens) {
-    handle_redirection(tokens, num_tokens, ">", O_WRONLY | O_CREAT | O_TRUNC, "Invalid output redirection syntax");
+// helper SIGTERM handler: drop our entry, then die from the signal as before
+static void registry_sigterm(int sig) {
+    unlink(registry_path);
+    signal(sig, SIG_DFL);
+    raise(sig);
 }
 
-// 11. Append output redirection
-void redir_append(char *tokens[], int num_tokens) {
-    handle_redirection(tokens, num_tokens, ">>", O_WRONLY | O_CREAT | O_APPEND, "Invalid append redirection syntax");
+// helper to remove our entry on a normal exit
+static void registry_remove(void) {
+    if(registry_fd >= 0) {
+        unlink(registry_path);
+        close(registry_fd);
+        registry_fd = -1;
+    }
 }
 
-// 12. Sequential execution
-void seqexec(char *tokens[], int num_tokens) {
-    // Count number of semicolons
-    int semi_count = 0;
-    for(int i=0; i<num_tokens; i++) {
-        if(strcmp(tokens[i], ";") == 0) {
-            semi_count = semi_count + 1;
-        }
+// helper to add this shell to the registry at startup
+void registry_register(void) {
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    if(runtime != NULL && runtime[0] == '/') {
+        snprintf(registry_dir, sizeof(registry_dir), "%s/f25shell", runtime);
+    } else {
+        snprintf(registry_dir, sizeof(registry_dir), "/tmp/f25shell-%d", (int)getuid());
     }
-    
-    // Validate max commands
-    if(semi_count > 4) {
-        printf("Maximum 4 sequential commands allowed\n");
+
+    // the directory must be ours alone, or another user could plant entries
+    struct stat st;
+    mkdir(registry_dir, 0700);
+    if(lstat(registry_dir, &st) < 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid()) {
+        registry_dir[0] = '\0';
         return;
     }
-    
-    // Execute commands sequentially
-    int start = 0;
-    for(int i=0; i<=num_tokens; i++) {
-        if(i == num_tokens || strcmp(tokens[i], ";") == 0) {
-            int cmd_len = i - start;
-                       
-            // Validate argc for this segment
-            if(cmd_len < 1 || cmd_len > 5 || cmd_len == 0) {
-                printf("Each command argc must be between 1 and 5\n");
-                return;
-            }
-            
-            // Build command array for this segment
-            char *cmd[MAX_ARGS];
-            for(int j=0; j<cmd_len; j++) {
-                cmd[j] = tokens[start + j];
-            }
-            cmd[cmd_len] = NULL;
-            
-            // Execute this command
-            int fork_res = fork();
-            if(fork_res == 0) {
-                execvp(cmd[0], cmd);
-                exit(1);
-            } else if(fork_res > 0) {
-                int status;
-                waitpid(fork_res, &status, 0);
-                
-                // Check if child process failed to exec
-                if(WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-                    // Command not found or exec failed - stop execution
-                    printf("Command execution failed, stopping sequential execution\n");
-                    return;
-                }
-            } else {
-                printf("Fork failed\n");
-                return;
-            }
-            start = i + 1;
-        }
+
+    // lock the entry under a name killallterms skips and only then give it
+    // its pid name, so a scan can never find it unlocked and remove it
+    char tmp_path[320];
+    snprintf(tmp_path, sizeof(tmp_path), "%s/.new-%d", registry_dir, (int)getpid());
+    snprintf(registry_path, sizeof(registry_path), "%s/%d", registry_dir, (int)getpid());
+    registry_fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if(registry_fd < 0) return;
+    if(flock(registry_fd, LOCK_EX | LOCK_NB) < 0 || rename(tmp_path, registry_path) < 0) {
+        unlink(tmp_path);
+        close(registry_fd);
+        registry_fd = -1;
+        return;
     }
+    atexit(registry_remove);
+    signal(SIGTERM, registry_sigterm);
 }
 
-// 13. Pipe execution
-void pipeexec(char *tokens[], int num_tokens) {
-    // Phase 1: Parse and store all commands
-    char *cmds[MAX_COMMANDS][MAX_ARGS];
-    int cmd_lens[MAX_COMMANDS];
-    int cmd_count = 0;
-    
-    // Count pipe operators
-    int pipe_count = 0;
-    for(int i=0; i<num_tokens; i++) {
-        if(strcmp(tokens[i], "|") == 0) {
-            pipe_count = pipe_count + 1;
-        }
+// helper to tell whether an entry's shell is gone; stale entries are removed
+static int registry_entry_stale(DIR *dir, const char *name, int fd) {
+    if(flock(fd, LOCK_SH | LOCK_NB) < 0) return 0;     // still held by its shell
+    unlinkat(dirfd(dir), name, 0);
+    return 1;
+}
+
+/* ======Functions====== */
+
+// helper to get all processes of our process group into session_procs
+void collect_processes(void) {
+    scan_processes(&session_procs, getpgid(0));
+}
+
+// 1. Kill current terminal
+void handle_killterm() {
+    pid_t pid = getpid();
+    // Terminate this process via SIGKILL to pid
+    int kill_status = kill(pid, SIGKILL);
+
+    // Print based on kill return value
+    if (kill_status == -1) {
+        printf("Failed to terminate f25shell\n");
+    } else {
+        printf("Current f25shell killed\n");
     }
+}
+
+// 2. Kill all terminals listed in the instance registry. A live entry is
+// locked by its shell; the pidfd is opened before re-checking the lock, so
+// the signal cannot hit a process that reused a dead shell's pid.
+void handle_killallterms() {
+    int killed = 0;
+    pid_t shell_id = getpid();
 
-    if(pipe_count > 4) {
-        printf("Maximum 4 piping operations allowed\n");
+    DIR *dir = registry_dir[0] ? opendir(registry_dir) : NULL;
+    if (!dir) {
+        printf("No other f25shell instances found.\n");
         return;
     }
-    
-    // Split tokens into command segments
-    int start = 0;
-    for(int i=0; i<=num_tokens; i++) {
-        if(i == num_tokens || strcmp(tokens[i], "|") == 0) {
-            int cmd_len = i - start;
-            
-            if(cmd_len < 1 || cmd_len > 5 || cmd_len == 0) {
-                printf("Each piped command argc must be between 1 and 5\n");
-                return;
-            }
-            
-            // Store command
-            for(int j=0; j<cmd_len; j++) {
-                cmds[cmd_count][j] = tokens[start + j];
-            }
-            cmds[cmd_count][cmd_len] = NULL;
-            cmd_lens[cmd_count] = cmd_len;
-            cmd_count = cmd_count + 1;   
-            start = i + 1;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // entries are named after the pid of their shell
+        if (!isdigit((unsigned char)entry->d_name[0])) continue;
+        pid_t pid = atoi(entry->d_name);
+        if (pid == shell_id) continue;
+
+        int fd = openat(dirfd(dir), entry->d_name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        if (registry_entry_stale(dir, entry->d_name, fd)) {
+            close(fd);
+            continue;
         }
-    }
 
-    // creating all pipes    
-    int pipes[cmd_count-1][2];
-    for(int p=0; p<cmd_count-1; p++) {
-        if(pipe(pipes[p]) < 0) {
-            printf("Pipe creation failed\n");
-            return;
+        // only a kernel without pidfds falls back to kill; ESRCH means the
+        // shell exited since the lock check and its entry is stale
+        int pidfd = open_pidfd(pid);
+        int pidfd_errno = errno;
+        if (pidfd < 0 && pidfd_errno == ESRCH) {
+            registry_entry_stale(dir, entry->d_name, fd);
+            close(fd);
+            continue;
+        }
+        if (pidfd >= 0 && registry_entry_stale(dir, entry->d_name, fd)) {
+            close(pidfd);
+            close(fd);
+            continue;
+        }
+        int sent = -1;
+        if (pidfd >= 0) {
+            sent = (int)syscall(SYS_pidfd_send_signal, pidfd, SIGTERM, NULL, 0);
+        } else if (pidfd_errno == ENOSYS) {
+            sent = kill(pid, SIGTERM);
         }
+        if (sent == 0) {
+            printf("Killed f25shell PID %d\n", pid);
+            killed = killed + 1;
+        } else {
+            printf("Failed to kill f25shell PID %d\n", pid);
+        }
+        if (pidfd >= 0) close(pidfd);
+        close(fd);
     }
-    
-    // Fork all children
-    for(int c=0; c<cmd_count; c++) {
-        int fork_res = fork();
-        
-        if(fork_res == 0) {
-            // Connect input pipe if not first command
-            if(c > 0) {
-                dup2(pipes[c-1][0], STDIN_FILENO);
+    closedir(dir);
+
+    if (killed == 0)
+        printf("No other f25shell instances found.\n");
+}
+
+// 4. Kill all processes other than current and bash
+void kill_all_processes() {
+    collect_processes();
+    int processes_killed = 0;
+    pid_t bash_id = getppid();
+    pid_t current_shell_id = getpid();
+
+    for(int i = 0; i < session_procs.count; i++) {
+        pid_t pid = session_procs.entries[i].pid;
+
+        // Check pid of all processes gathered is not equal to bash id or current shell id
+        if (pid != bash_id && pid != current_shell_id) {
+            if (kill(pid, SIGKILL) == 0) {
+                printf("Killed process %d\n", pid);
+                processes_killed = processes_killed + 1;
+            } else if (errno == ESRCH) {
+                // Process already dead - not an error
+                processes_killed = processes_killed + 1;  // Count as success
+            } else {
+                printf("Failed to kill process %d\n", pid);
+            }
+        }
+    }
+}
+
+/* ======Word Count Kernels====== */
+
+// A word starts at every non-whitespace byte whose predecessor is whitespace
+// (or the start of input when no word was open). Counting starts gives the
+// same total as counting whitespace transitions plus a trailing open word,
+// and lets the vector kernels work on whole bitmasks at once.
+struct wc_state {
+    uint64_t words;
+    int in_word;    // last byte seen was part of a word
+};
+
+// helper for the four whitespace bytes the shell splits words on
+static inline int wc_is_space(unsigned char ch) {
+    return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r';
+}
+
+// helper scalar kernel, also used for the tails of the vector kernels
+static void wc_scalar(const unsigned char *buf, size_t len, struct wc_state *st) {
+    uint64_t words = st->words;
+    int in_word = st->in_word;
+    for(size_t i = 0; i < len; i++) {
+        int is_word = !wc_is_space(buf[i]);
+        words += is_word & !in_word;
+        in_word = is_word;
+    }
+    st->words = words;
+    st->in_word = in_word;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// helper adding the word starts in one 64-byte block given its space bitmask
+static inline void wc_block(uint64_t space_mask, struct wc_state *st) {
+    uint64_t word_mask = ~space_mask;
+    uint64_t prev_word = (word_mask << 1) | (uint64_t)st->in_word;
+    st->words += __builtin_popcountll(word_mask & ~prev_word);
+    st->in_word = (int)(word_mask >> 63);
+}
+
+// helper SSE2 kernel: four 16-byte compares per 64-byte block
+__attribute__((target("sse2")))
+static void wc_sse2(const unsigned char *buf, size_t len, struct wc_state *st) {
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i tb = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    size_t i = 0;
+    for(; i + 64 <= len; i += 64) {
+        uint64_t mask = 0;
+        for(int part = 0; part < 4; part++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(buf + i + part * 16));
+            __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, nl)),
+                                      _mm_or_si128(_mm_cmpeq_epi8(v, tb), _mm_cmpeq_epi8(v, cr)));
+            mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << (part * 16);
+        }
+        wc_block(mask, st);
+    }
+    wc_scalar(buf + i, len - i, st);
+}
+
+// helper AVX2 kernel: two 32-byte compares per 64-byte block
+__attribute__((target("avx2,popcnt")))
+static void wc_avx2(const unsigned char *buf, size_t len, struct wc_state *st) {
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i tb = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    uint64_t words = st->words;
+    uint64_t carry = (uint64_t)st->in_word;
+    size_t i = 0;
+    for(; i + 64 <= len; i += 64) {
+        __m256i lo = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i *)(buf + i + 32));
+        __m256i ws_lo = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(lo, sp), _mm256_cmpeq_epi8(lo, nl)),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(lo, tb), _mm256_cmpeq_epi8(lo, cr)));
+        __m256i ws_hi = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(hi, sp), _mm256_cmpeq_epi8(hi, nl)),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(hi, tb), _mm256_cmpeq_epi8(hi, cr)));
+        uint64_t word_mask = ~((uint64_t)(uint32_t)_mm256_movemask_epi8(ws_lo)
+                             | ((uint64_t)(uint32_t)_mm256_movemask_epi8(ws_hi) << 32));
+        words += (uint64_t)__builtin_popcountll(word_mask & ~((word_mask << 1) | carry));
+        carry = word_mask >> 63;
+    }
+    st->words = words;
+    st->in_word = (int)carry;
+    wc_scalar(buf + i, len - i, st);
+}
+#endif
+
+// kernel picked on first use for the running CPU
+static void (*wc_kernel)(const unsigned char *, size_t, struct wc_state *) = NULL;
+
+// helper to pick the kernel for the running CPU. Only the shell thread calls
+// it, before any counting thread starts, so wc_kernel is never raced on.
+static void wc_kernel_init(void) {
+    if(wc_kernel != NULL) return;
+    void (*kernel)(const unsigned char *, size_t, struct wc_state *) = wc_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        kernel = wc_avx2;
+    } else if(__builtin_cpu_supports("sse2")) {
+        kernel = wc_sse2;
+    }
+#endif
+    wc_kernel = kernel;
+}
+
+// helper to count words in a buffer, continuing from the state in st
+void wc_count(const unsigned char *buf, size_t len, struct wc_state *st) {
+    wc_kernel_init();
+    wc_kernel(buf, len, st);
+}
+
+// one slice of a mapped file counted independently of its neighbours
+struct wc_chunk {
+    const unsigned char *start;
+    size_t len;
+    struct wc_state st;     // counted as if no word was open before start
+};
+
+// work shared by the counting threads; chunks are claimed in order
+struct wc_job {
+    struct wc_chunk chunks[WC_MAX_CHUNKS];
+    int chunk_count;
+    int next_chunk;
+};
+
+// helper thread body: keep claiming chunks until none are left
+static void *wc_worker(void *arg) {
+    struct wc_job *job = arg;
+    while(1) {
+        int idx = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED);
+        if(idx >= job->chunk_count) break;
+        struct wc_chunk *chunk = &job->chunks[idx];
+        wc_count(chunk->start, chunk->len, &chunk->st);
+    }
+    return NULL;
+}
+
+// helper to count a large mapped buffer on all available cores. Each chunk
+// counts a word at its first byte; when the previous chunk ended inside a
+// word that start is really a continuation, so it is taken back out.
+static uint64_t wc_count_parallel(const unsigned char *buf, size_t len, int threads) {
+    static struct wc_job job;
+    size_t chunks = len / WC_CHUNK_MIN;
+    if(chunks > WC_MAX_CHUNKS) chunks = WC_MAX_CHUNKS;
+    if(chunks < (size_t)threads) chunks = threads;
+    size_t chunk_len = (len + chunks - 1) / chunks;
+
+    job.chunk_count = 0;
+    job.next_chunk = 0;
+    for(size_t off = 0; off < len; off += chunk_len) {
+        struct wc_chunk *chunk = &job.chunks[job.chunk_count++];
+        chunk->start = buf + off;
+        chunk->len = (len - off < chunk_len) ? len - off : chunk_len;
+        chunk->st.words = 0;
+        chunk->st.in_word = 0;
+    }
+
+    // this thread works too, so only threads-1 extra ones are started; the
+    // workers find the kernel already chosen
+    wc_kernel_init();
+    pthread_t tids[WC_MAX_THREADS];
+    int started = 0;
+    for(int t = 1; t < threads; t++) {
+        if(pthread_create(&tids[started], NULL, wc_worker, &job) == 0) {
+            started = started + 1;
+        }
+    }
+    wc_worker(&job);
+    for(int t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+
+    // stitch the chunks back together across their boundaries
+    uint64_t words = 0;
+    for(int c = 0; c < job.chunk_count; c++) {
+        words += job.chunks[c].st.words;
+        if(c > 0 && job.chunks[c-1].st.in_word && !wc_is_space(job.chunks[c].start[0])) {
+            words = words - 1;
+        }
+    }
+    return words;
+}
+
+// helper to count the cores this process may run on
+static int wc_thread_count(void) {
+    cpu_set_t set;
+    int cpus = 1;
+    if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+        cpus = CPU_COUNT(&set);
+    }
+    if(cpus > WC_MAX_THREADS) cpus = WC_MAX_THREADS;
+    return cpus < 1 ? 1 : cpus;
+}
+
+// helper to count every word readable from fd, a pipe or other stream, in
+// large blocks. Returns 0 or -1.
+int wordcount_fd(int fd, uint64_t *count) {
+    struct wc_state st = { 0, 0 };
+    static unsigned char buffer[WC_READ_SIZE];
+    ssize_t bytes_read;
+    while((bytes_read = read(fd, buffer, sizeof(buffer))) != 0) {
+        if(bytes_read < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        wc_count(buffer, (size_t)bytes_read, &st);
+    }
+    *count = st.words;
+    return 0;
+}
+
+/* ======Word Count Cache====== */
+
+// # results keyed by device, inode, size and mtime, so an unchanged file
+// is answered without reading it. A file that only grew (same inode, larger
+// size) whose last WC_TAIL_SIZE bytes before the old end still hash the same
+// is treated as appended to: counting resumes at the old end with the
+// in_word state saved there, so checking a growing log costs O(new data).
+// Anything else that changed, including a file truncated and rewritten
+// larger, is counted again from the start. With wccache -f FILE the table
+// is also kept on disk across shells.
+struct wc_cache_entry {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    uint64_t words;
+    uint64_t tail;      // hash of the bytes just before size
+    int in_word;        // the last counted byte was inside a word
+    int used;
+};
+
+struct wc_cache_entry wc_cache[WC_CACHE_SIZE];
+int wc_cache_count = 0;
+uint64_t wc_cache_hits = 0;
+uint64_t wc_cache_appends = 0;  // answered by counting only appended bytes
+uint64_t wc_cache_misses = 0;
+char *wc_cache_file = NULL;     // on-disk copy, NULL when memory only
+
+// helper to find the slot for a file: its entry, or the free slot it would
+// take, or when the table is full its home slot to overwrite
+static struct wc_cache_entry *wc_cache_slot(dev_t dev, ino_t ino) {
+    uint64_t hash = ((uint64_t)dev * 1099511628211ULL) ^ ((uint64_t)ino * 0x9e3779b97f4a7c15ULL);
+    unsigned home = (unsigned)(hash >> 32) & (WC_CACHE_SIZE - 1);
+    for(int probe = 0; probe < WC_CACHE_SIZE; probe++) {
+        struct wc_cache_entry *entry = &wc_cache[(home + probe) & (WC_CACHE_SIZE - 1)];
+        if(!entry->used || (entry->dev == dev && entry->ino == ino)) return entry;
+    }
+    return &wc_cache[home];
+}
+
+// helper to hash the up to WC_TAIL_SIZE bytes of fd that end at end, the
+// fingerprint telling an appended file from a rewritten one
+static int wc_tail_hash(int fd, off_t end, uint64_t *hash) {
+    unsigned char buffer[WC_TAIL_SIZE];
+    off_t start = end > WC_TAIL_SIZE ? end - WC_TAIL_SIZE : 0;
+    size_t got = 0;
+    while(got < (size_t)(end - start)) {
+        ssize_t n = pread(fd, buffer + got, (size_t)(end - start) - got, start + (off_t)got);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return -1;
+        got += (size_t)n;
+    }
+    uint64_t h = 1469598103934665603ULL;
+    for(size_t i = 0; i < got; i++) {
+        h = (h ^ buffer[i]) * 1099511628211ULL;
+    }
+    *hash = h;
+    return 0;
+}
+
+// helper to record the count for a file state
+static void wc_cache_store(const struct stat *info, const struct wc_state *st, uint64_t tail) {
+    struct wc_cache_entry *entry = wc_cache_slot(info->st_dev, info->st_ino);
+    if(!entry->used) wc_cache_count = wc_cache_count + 1;
+    entry->dev = info->st_dev;
+    entry->ino = info->st_ino;
+    entry->size = info->st_size;
+    entry->mtime = info->st_mtim;
+    entry->words = st->words;
+    entry->tail = tail;
+    entry->in_word = st->in_word;
+    entry->used = 1;
+}
+
+// helper to write the table to the cache file; a temporary file renamed
+// over it keeps readers from ever seeing half a table
+static void wc_cache_save(void) {
+    if(wc_cache_file == NULL) return;
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.%d", wc_cache_file, (int)getpid());
+    FILE *out = fopen(tmp, "we");
+    if(out == NULL) return;
+    for(int i = 0; i < WC_CACHE_SIZE; i++) {
+        struct wc_cache_entry *entry = &wc_cache[i];
+        if(!entry->used) continue;
+        fprintf(out, "%ju %ju %jd %jd %ld %" PRIu64 " %d %" PRIx64 "\n", (uintmax_t)entry->dev,
+                (uintmax_t)entry->ino, (intmax_t)entry->size, (intmax_t)entry->mtime.tv_sec,
+                entry->mtime.tv_nsec, entry->words, entry->in_word, entry->tail);
+    }
+    if(fclose(out) != 0 || rename(tmp, wc_cache_file) != 0) unlink(tmp);
+}
+
+// helper to merge the entries of the cache file into the table
+static void wc_cache_load(void) {
+    FILE *in = fopen(wc_cache_file, "re");
+    if(in == NULL) return;
+    uintmax_t dev, ino;
+    intmax_t size, sec;
+    long nsec;
+    struct wc_state st;
+    uint64_t tail;
+    while(fscanf(in, "%ju %ju %jd %jd %ld %" SCNu64 " %d %" SCNx64, &dev, &ino, &size, &sec, &nsec,
+                 &st.words, &st.in_word, &tail) == 8) {
+        struct stat info;
+        memset(&info, 0, sizeof(info));
+        info.st_dev = (dev_t)dev;
+        info.st_ino = (ino_t)ino;
+        info.st_size = (off_t)size;
+        info.st_mtim.tv_sec = (time_t)sec;
+        info.st_mtim.tv_nsec = nsec;
+        wc_cache_store(&info, &st, tail);
+    }
+    fclose(in);
+}
+
+// helper to count bytes offset..size of a regular file on top of st, so the
+// count carries on exactly where an earlier one stopped
+static int wordcount_from(int fd, off_t offset, off_t size, struct wc_state *st) {
+    if(offset >= size) return 0;
+    off_t start = offset - offset % (off_t)sysconf(_SC_PAGESIZE);
+    size_t len = (size_t)(size - start);
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, start);
+    if(map != MAP_FAILED) {
+        const unsigned char *data = (const unsigned char *)map + (offset - start);
+        size_t count = (size_t)(size - offset);
+        madvise(map, len, MADV_SEQUENTIAL);
+        int threads = count >= WC_PARALLEL_MIN ? wc_thread_count() : 1;
+        if(threads > 1) {
+            // the threads start outside a word; a word running across the
+            // old end was already counted
+            uint64_t words = wc_count_parallel(data, count, threads);
+            if(st->in_word && !wc_is_space(data[0])) words = words - 1;
+            st->words += words;
+            st->in_word = !wc_is_space(data[count - 1]);
+        } else {
+            wc_count(data, count, st);
+        }
+        munmap(map, len);
+        return 0;
+    }
+
+    static unsigned char buffer[WC_READ_SIZE];
+    while(offset < size) {
+        size_t want = size - offset < (off_t)sizeof(buffer) ? (size_t)(size - offset) : sizeof(buffer);
+        ssize_t n = pread(fd, buffer, want, offset);
+        if(n < 0 && errno == EINTR) continue;
+        if(n < 0) return -1;
+        if(n == 0) break;
+        wc_count(buffer, (size_t)n, st);
+        offset += n;
+    }
+    return 0;
+}
+
+// helper to count the words of a stage input # did not open itself. It is
+// counted from its current offset, which someone may already have read
+// past, and left at the end as reading it would; the cache is not used.
+int wordcount_input(int fd, uint64_t *count) {
+    struct stat info;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if(offset < 0 || fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) return wordcount_fd(fd, count);
+
+    struct wc_state st = { 0, 0 };
+    if(wordcount_from(fd, offset, info.st_size, &st) < 0) return -1;
+    if(offset < info.st_size) lseek(fd, info.st_size, SEEK_SET);
+    *count = st.words;
+    return 0;
+}
+
+// helper to count the words of a file # opened through the cache. Anything
+// that is not a regular file is always counted.
+int wordcount_cached(int fd, uint64_t *count) {
+    struct stat info;
+    if(fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) return wordcount_fd(fd, count);
+
+    struct wc_cache_entry *entry = wc_cache_slot(info.st_dev, info.st_ino);
+    if(entry->used && entry->dev == info.st_dev && entry->ino == info.st_ino
+            && entry->size == info.st_size && entry->mtime.tv_sec == info.st_mtim.tv_sec
+            && entry->mtime.tv_nsec == info.st_mtim.tv_nsec) {
+        wc_cache_hits = wc_cache_hits + 1;
+        *count = entry->words;
+        return 0;
+    }
+
+    // 28. same file, only longer and still ending the same way at the old
+    // size: count what was appended. Anything else is counted from 0.
+    struct wc_state st = { 0, 0 };
+    off_t from = 0;
+    uint64_t tail;
+    if(entry->used && entry->dev == info.st_dev && entry->ino == info.st_ino
+            && entry->size < info.st_size && wc_tail_hash(fd, entry->size, &tail) == 0
+            && tail == entry->tail) {
+        st.words = entry->words;
+        st.in_word = entry->in_word;
+        from = entry->size;
+        wc_cache_appends = wc_cache_appends + 1;
+    } else {
+        wc_cache_misses = wc_cache_misses + 1;
+    }
+    if(wordcount_from(fd, from, info.st_size, &st) < 0) return -1;
+    *count = st.words;
+
+    // a write landing while we counted leaves a newer mtime: keep nothing
+    struct stat after;
+    if(fstat(fd, &after) == 0 && after.st_size == info.st_size
+            && after.st_mtim.tv_sec == info.st_mtim.tv_sec && after.st_mtim.tv_nsec == info.st_mtim.tv_nsec
+            && wc_tail_hash(fd, info.st_size, &tail) == 0) {
+        wc_cache_store(&info, &st, tail);
+        wc_cache_save();
+    }
+    return 0;
+}
+
+// 26. Show word count cache statistics, clear it (wccache -c) or keep it in
+// a file as well (wccache -f FILE), loading what the file already holds
+int handle_wccache(char *tokens[], int num_tokens) {
+    if(num_tokens == 1) {
+        printf("Word count cache: %d entries, %" PRIu64 " hits, %" PRIu64 " appends, %" PRIu64
+               " misses, file %s\n", wc_cache_count, wc_cache_hits, wc_cache_appends, wc_cache_misses,
+               wc_cache_file ? wc_cache_file : "none");
+        return 0;
+    }
+    if(num_tokens == 2 && strcmp(tokens[1], "-c") == 0) {
+        memset(wc_cache, 0, sizeof(wc_cache));
+        wc_cache_count = 0;
+        wc_cache_save();
+        return 0;
+    }
+    if(num_tokens == 3 && strcmp(tokens[1], "-f") == 0) {
+        char *file = strdup(tokens[2]);
+        if(file == NULL) {
+            printf("Out of memory\n");
+            return 1;
+        }
+        free(wc_cache_file);
+        wc_cache_file = file;
+        wc_cache_load();
+        wc_cache_save();
+        return 0;
+    }
+    printf("Usage: wccache [-c | -f file]\n");
+    return 1;
+}
+
+/* ======Copy Helpers====== */
+
+// helper to write all of buf, retrying after short writes and signals
+int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while(len > 0) {
+        ssize_t n = write(fd, p, len);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// helper for errors meaning "this copy method does not apply to these fds"
+static int copy_unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EBADF
+        || err == EOPNOTSUPP || err == ESPIPE;
+}
+
+// helper to copy up to limit bytes from in_fd to out_fd at their current
+// offsets. The kernel moves the data where it can: copy_file_range between
+// files (reflinks on filesystems that support them), sendfile from a file,
+// splice to or from a pipe. Other pairs go through a 1 MB buffer. Each method
+// advances the offsets, so a later one picks up where an earlier one stopped.
+// Returns 0 at EOF or once limit bytes are copied, -1 on error.
+int copy_data(int in_fd, int out_fd, uint64_t limit) {
+    struct stat in_st, out_st;
+    if(fstat(in_fd, &in_st) < 0 || fstat(out_fd, &out_st) < 0) return -1;
+
+    uint64_t left = limit;
+    int use_cfr = S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode);
+    int use_sendfile = S_ISREG(in_st.st_mode);
+    int use_splice = S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode);
+
+    while(left > 0) {
+        size_t want = left < COPY_CHUNK ? (size_t)left : COPY_CHUNK;
+        ssize_t n;
+
+        if(use_cfr) {
+            n = copy_file_range(in_fd, NULL, out_fd, NULL, want, 0);
+            if(n < 0 && copy_unsupported(errno)) { use_cfr = 0; continue; }
+        } else if(use_sendfile) {
+            n = sendfile(out_fd, in_fd, NULL, want);
+            if(n < 0 && copy_unsupported(errno)) { use_sendfile = 0; continue; }
+        } else if(use_splice) {
+            n = splice(in_fd, NULL, out_fd, NULL, want, SPLICE_F_MOVE);
+            if(n < 0 && copy_unsupported(errno)) { use_splice = 0; continue; }
+        } else {
+            static char buffer[COPY_BUFFER_SIZE];
+            n = read(in_fd, buffer, want < sizeof(buffer) ? want : sizeof(buffer));
+            if(n > 0 && write_all(out_fd, buffer, (size_t)n) < 0) return -1;
+        }
+
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        if(n == 0) break;  // end of input
+        left -= (uint64_t)n;
+    }
+    return 0;
+}
+
+/* ======Audit Log====== */
+
+// Every pipeline run is recorded with its line, stage pids, exit statuses
+// and duration. The shell thread only copies a fixed-size record into a
+// single-producer/single-consumer ring and publishes it with one atomic
+// store; a writer thread drains the ring in batches and appends JSON lines
+// to the audit file. When the ring is full the record is dropped and
+// counted instead of making the shell wait, and the writer logs the count.
+struct audit_record {
+    uint64_t line;              // input line number in this shell
+    int64_t start;              // CLOCK_REALTIME, ns
+    int64_t duration;           // ns, -1 for a background launch
+    int background;             // launched with &, its exit is a record of its own
+    int count;                  // stages, may exceed AUDIT_MAX_STAGES
+    pid_t pids[AUDIT_MAX_STAGES];
+    int statuses[AUDIT_MAX_STAGES];
+    char text[AUDIT_TEXT_SIZE];
+};
+
+struct audit_record audit_ring[AUDIT_RING_SIZE];
+_Atomic uint64_t audit_head = 0;        // next slot the shell fills
+_Atomic uint64_t audit_tail = 0;        // next slot the writer reads
+_Atomic uint64_t audit_dropped = 0;
+_Atomic int audit_stopping = 0;
+int audit_enabled = 0;
+int audit_fd = -1;
+char *audit_path = NULL;
+pthread_t audit_thread;
+uint64_t audit_line_no = 0;
+char audit_text[AUDIT_TEXT_SIZE];       // the line being run, set per line
+
+// helper to queue a record for the writer; never blocks
+static void audit_push(const struct audit_record *rec) {
+    uint64_t head = atomic_load_explicit(&audit_head, memory_order_relaxed);
+    if(head - atomic_load_explicit(&audit_tail, memory_order_acquire) >= AUDIT_RING_SIZE) {
+        atomic_fetch_add_explicit(&audit_dropped, 1, memory_order_relaxed);
+        return;
+    }
+    audit_ring[head & (AUDIT_RING_SIZE - 1)] = *rec;
+    atomic_store_explicit(&audit_head, head + 1, memory_order_release);
+}
+
+// helper to record one pipeline; duration < 0 marks a background launch
+static void audit_pipeline(const pid_t *pids, const int *statuses, int count, int64_t start,
+                           int64_t duration) {
+    struct audit_record rec;
+    rec.line = audit_line_no;
+    rec.start = start;
+    rec.duration = duration;
+    rec.background = duration < 0;
+    rec.count = count;
+    for(int c = 0; c < count && c < AUDIT_MAX_STAGES; c++) {
+        rec.pids[c] = pids[c];
+        rec.statuses[c] = statuses != NULL ? statuses[c] : -1;
+    }
+    memcpy(rec.text, audit_text, sizeof(rec.text));
+    audit_push(&rec);
+}
+
+// helper to read CLOCK_REALTIME in ns for audit records
+static int64_t audit_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// helper to log the launch of background pid and mark its job so the exit
+// is logged too
+static void audit_job_started(pid_t pid, int64_t start) {
+    struct job *job = job_find(pid);
+    if(job != NULL) {
+        job->audit_pending = 1;
+        job->start_ns = start;
+        job->line = audit_line_no;
+    }
+}
+
+// helper to log background jobs that have exited since the last call. The
+// SIGCHLD handler only marks them, so every push stays on the shell thread.
+static void audit_jobs(void) {
+    sigset_t old;
+    jobs_block(&old);
+    for(int i = 0; i < MAX_BG_JOBS; i++) {
+        struct job *job = &job_table[i];
+        if(!job->audit_pending || job->state == JOB_RUNNING || job->state == JOB_QUEUED) continue;
+        struct audit_record rec;
+        rec.line = job->line;
+        rec.start = job->start_ns;
+        rec.duration = job->end_ns - job->start_ns;
+        rec.background = 1;
+        rec.count = 1;
+        rec.pids[0] = job->pid;
+        rec.statuses[0] = job->status;
+        snprintf(rec.text, sizeof(rec.text), "%s &", job->label);
+        audit_push(&rec);
+        job->audit_pending = 0;
+    }
+    jobs_unblock(&old);
+}
+
+// helper to append rec as one JSON line to out; returns the bytes used
+static size_t audit_format(const struct audit_record *rec, char *out, size_t size) {
+    char text[AUDIT_TEXT_SIZE * 6];
+    size_t t = 0;
+    for(const unsigned char *p = (const unsigned char *)rec->text; *p != '\0'; p++) {
+        if(*p == '"' || *p == '\\') {
+            text[t++] = '\\';
+            text[t++] = (char)*p;
+        } else if(*p < 0x20) {
+            t += (size_t)snprintf(text + t, sizeof(text) - t, "\\u%04x", *p);
+        } else {
+            text[t++] = (char)*p;
+        }
+    }
+    text[t] = '\0';
+
+    int n = snprintf(out, size, "{\"shell\":%d,\"line\":%" PRIu64 ",\"start_ns\":%" PRId64
+                     ",\"duration_ns\":%" PRId64 ",\"background\":%s,\"cmd\":\"%s\",\"stages\":%d,\"pids\":[",
+                     (int)getpid(), rec->line, rec->start, rec->duration,
+                     rec->background ? "true" : "false", text, rec->count);
+    int kept = rec->count < AUDIT_MAX_STAGES ? rec->count : AUDIT_MAX_STAGES;
+    for(int c = 0; c < kept; c++) {
+        n += snprintf(out + n, size - (size_t)n, "%s%d", c ? "," : "", (int)rec->pids[c]);
+    }
+    n += snprintf(out + n, size - (size_t)n, "],\"statuses\":[");
+    for(int c = 0; c < kept; c++) {
+        n += snprintf(out + n, size - (size_t)n, "%s%d", c ? "," : "", rec->statuses[c]);
+    }
+    n += snprintf(out + n, size - (size_t)n, "]}\n");
+    return (size_t)n;
+}
+
+// writer thread: drain whatever is queued in one write, then sleep 10 ms,
+// twice as long each time nothing came, up to half a second
+static void *audit_writer(void *arg) {
+    (void)arg;
+    static char batch[1 << 16];
+    uint64_t reported_drops = 0;
+    long idle_ms = 10;
+    while(1) {
+        int stopping = atomic_load_explicit(&audit_stopping, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&audit_tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&audit_head, memory_order_acquire);
+        size_t len = 0;
+        while(tail != head) {
+            if(sizeof(batch) - len < 2048) {
+                write_all(audit_fd, batch, len);
+                len = 0;
+            }
+            len += audit_format(&audit_ring[tail & (AUDIT_RING_SIZE - 1)], batch + len, sizeof(batch) - len);
+            tail = tail + 1;
+            atomic_store_explicit(&audit_tail, tail, memory_order_release);
+        }
+        uint64_t drops = atomic_load_explicit(&audit_dropped, memory_order_relaxed);
+        if(drops != reported_drops) {
+            len += (size_t)snprintf(batch + len, sizeof(batch) - len,
+                                    "{\"shell\":%d,\"dropped\":%" PRIu64 "}\n", (int)getpid(), drops);
+            reported_drops = drops;
+        }
+        if(len > 0) {
+            write_all(audit_fd, batch, len);
+            idle_ms = 10;
+        } else if(idle_ms < 500) {
+            idle_ms = idle_ms * 2 > 500 ? 500 : idle_ms * 2;
+        }
+        if(stopping) break;
+        struct timespec nap = { idle_ms / 1000, (idle_ms % 1000) * 1000000 };
+        nanosleep(&nap, NULL);
+    }
+    return NULL;
+}
+
+// helper to flush what is queued, stop the writer and close the file
+void audit_stop(void) {
+    if(!audit_enabled) return;
+    audit_jobs();
+    // jobs still running when logging stops are not logged later
+    for(int i = 0; i < MAX_BG_JOBS; i++) job_table[i].audit_pending = 0;
+    audit_enabled = 0;
+    atomic_store_explicit(&audit_stopping, 1, memory_order_release);
+    pthread_join(audit_thread, NULL);
+    close(audit_fd);
+    audit_fd = -1;
+}
+
+// helper to start logging to path, replacing any earlier audit file
+int audit_start(const char *path) {
+    static int registered = 0;
+    audit_stop();
+    char *copy = strdup(path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if(copy == NULL || fd < 0) {
+        printf("Failed to open file %s\n", path);
+        free(copy);
+        if(fd >= 0) close(fd);
+        return 1;
+    }
+
+    // the writer must never take the shell's signals, SIGCHLD above all
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    audit_fd = fd;
+    atomic_store(&audit_stopping, 0);
+    int err = pthread_create(&audit_thread, NULL, audit_writer, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if(err != 0) {
+        printf("Failed to start audit writer: %s\n", strerror(err));
+        close(fd);
+        audit_fd = -1;
+        free(copy);
+        return 1;
+    }
+    free(audit_path);
+    audit_path = copy;
+    audit_enabled = 1;
+    if(!registered) {
+        atexit(audit_stop);
+        registered = 1;
+    }
+    return 0;
+}
+
+// 27. Show audit log state, start logging to a file (audit -f FILE) or
+// stop (audit -s)
+int handle_audit(char *tokens[], int num_tokens) {
+    if(num_tokens == 1) {
+        printf("Audit log: %s, %" PRIu64 " recorded, %" PRIu64 " dropped\n",
+               audit_enabled ? audit_path : "off", atomic_load(&audit_head), atomic_load(&audit_dropped));
+        return 0;
+    }
+    if(num_tokens == 2 && strcmp(tokens[1], "-s") == 0) {
+        audit_stop();
+        return 0;
+    }
+    if(num_tokens == 3 && strcmp(tokens[1], "-f") == 0) {
+        return audit_start(tokens[2]);
+    }
+    printf("Usage: audit [-f file | -s]\n");
+    return 1;
+}
+
+/* ======Utilities====== */
+
+// In-process versions of small commands scripts run constantly. They read
+// in_fd and write out_fd directly, so the executors can run them without
+// fork+exec; a pipeline stage still gets a forked copy of the shell so the
+// stages run concurrently. Errors go to stderr like the real tools.
+
+// helper to report a utility error on stderr
+static void util_error(const char *name, const char *what) {
+    dprintf(STDERR_FILENO, "%s: %s: %s\n", name, what, strerror(errno));
+}
+
+// helper to parse a non-negative count argument, -1 if invalid
+static long long util_number(const char *text) {
+    char *end;
+    errno = 0;
+    long long value = strtoll(text, &end, 10);
+    if(errno != 0 || end == text || *end != '\0' || value < 0) return -1;
+    return value;
+}
+
+static int util_true(int argc, char *argv[], int in_fd, int out_fd) {
+    (void)argc; (void)argv; (void)in_fd; (void)out_fd;
+    return 0;
+}
+
+static int util_false(int argc, char *argv[], int in_fd, int out_fd) {
+    (void)argc; (void)argv; (void)in_fd; (void)out_fd;
+    return 1;
+}
+
+// echo [-n] args...
+static int util_echo(int argc, char *argv[], int in_fd, int out_fd) {
+    (void)in_fd;
+    size_t len = 0;
+    int newline = 1;
+    int first = 1;
+    if(argc > 1 && strcmp(argv[1], "-n") == 0) {
+        newline = 0;
+        first = 2;
+    }
+    // one write for the whole line, sized for the words and separators
+    size_t size = 1;
+    for(int i = first; i < argc; i++) size += strlen(argv[i]) + 1;
+    char *line = arena_alloc(&line_arena, size);
+    for(int i = first; i < argc; i++) {
+        size_t word = strlen(argv[i]);
+        if(i > first) line[len++] = ' ';
+        memcpy(line + len, argv[i], word);
+        len += word;
+    }
+    if(newline) line[len++] = '\n';
+    return write_all(out_fd, line, len) < 0 ? 1 : 0;
+}
+
+// cat [file|-]...
+static int util_cat(int argc, char *argv[], int in_fd, int out_fd) {
+    int status = 0;
+    for(int i = 1; i < argc || (argc == 1 && i == 1); i++) {
+        const char *name = argc == 1 ? "-" : argv[i];
+        int fd = in_fd;
+        if(strcmp(name, "-") != 0) {
+            fd = open(name, O_RDONLY | O_CLOEXEC);
+            if(fd < 0) {
+                util_error("cat", name);
+                status = 1;
+                continue;
             }
-            
-            // Connect output pipe if not last command
-            if(c < cmd_count-1) {
-                dup2(pipes[c][1], STDOUT_FILENO);
+        }
+        if(copy_data(fd, out_fd, COPY_ALL) < 0) {
+            util_error("cat", name);
+            status = 1;
+        }
+        if(fd != in_fd) close(fd);
+    }
+    return status;
+}
+
+// helper to copy the first limit lines (or bytes) of in_fd to out_fd
+static int head_copy(int in_fd, int out_fd, long long limit, int bytes_mode) {
+    static char buf[1 << 16];
+    while(limit > 0) {
+        ssize_t n = read(in_fd, buf, sizeof(buf));
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return n < 0 ? -1 : 0;
+
+        size_t take = (size_t)n;
+        if(bytes_mode) {
+            if((long long)take > limit) take = (size_t)limit;
+            limit -= (long long)take;
+        } else {
+            for(ssize_t i = 0; i < n; i++) {
+                if(buf[i] == '\n' && --limit == 0) {
+                    take = (size_t)i + 1;
+                    break;
+                }
             }
-            
-            // Close all pipe file descriptors
-            int x;
-            for(x=0; x<cmd_count-1; x++) {
-                close(pipes[x][0]);
-                close(pipes[x][1]);
+        }
+        if(write_all(out_fd, buf, take) < 0) return -1;
+    }
+    return 0;
+}
+
+// head [-n N | -N | -c N] [file]...
+static int util_head(int argc, char *argv[], int in_fd, int out_fd) {
+    long long limit = 10;
+    int bytes_mode = 0;
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        const char *value = NULL;
+        if(argv[i][1] == 'n' || argv[i][1] == 'c') {
+            bytes_mode = (argv[i][1] == 'c');
+            value = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : NULL);
+        } else {
+            value = argv[i] + 1;
+        }
+        limit = value ? util_number(value) : -1;
+        if(limit < 0) {
+            dprintf(STDERR_FILENO, "head: invalid number of lines\n");
+            return 1;
+        }
+    }
+
+    int status = 0;
+    int files = argc - i;
+    for(int f = i; f < argc || (files == 0 && f == i); f++) {
+        const char *name = files == 0 ? "-" : argv[f];
+        int fd = in_fd;
+        if(strcmp(name, "-") != 0) {
+            fd = open(name, O_RDONLY | O_CLOEXEC);
+            if(fd < 0) {
+                util_error("head", name);
+                status = 1;
+                continue;
             }
-            
-            execvp(cmds[c][0], cmds[c]);
-            exit(1);
-        } else if(fork_res < 0) {
-            printf("Fork failed\n");
+        }
+        if(files > 1) {
+            dprintf(out_fd, "%s==> %s <==\n", f > i ? "\n" : "", name);
+        }
+        if(head_copy(fd, out_fd, limit, bytes_mode) < 0) {
+            util_error("head", name);
+            status = 1;
+        }
+        if(fd != in_fd) close(fd);
+    }
+    return status;
+}
+
+// helper to count lines, words and bytes of one fd with the # kernels
+static int wc_fd(int fd, uint64_t counts[3]) {
+    static unsigned char buf[WC_READ_SIZE];
+    struct wc_state st = { 0, 0 };
+    uint64_t lines = 0, bytes = 0;
+    ssize_t n;
+    while((n = read(fd, buf, sizeof(buf))) != 0) {
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        for(unsigned char *p = buf; (p = memchr(p, '\n', (size_t)(buf + n - p))) != NULL; p++) {
+            lines = lines + 1;
+        }
+        wc_count(buf, (size_t)n, &st);
+        bytes += (uint64_t)n;
+    }
+    counts[0] = lines;
+    counts[1] = st.words;
+    counts[2] = bytes;
+    return 0;
+}
+
+// helper to print one wc row with the selected columns
+static void wc_print(int out_fd, const uint64_t counts[3], const int show[3], int width, const char *name) {
+    char row[128];
+    int len = 0;
+    for(int c = 0; c < 3; c++) {
+        if(!show[c]) continue;
+        len += snprintf(row + len, sizeof(row) - len, "%s%*" PRIu64, len ? " " : "", width, counts[c]);
+    }
+    dprintf(out_fd, "%s%s%s\n", row, name ? " " : "", name ? name : "");
+}
+
+// wc [-l] [-w] [-c] [file]...
+static int util_wc(int argc, char *argv[], int in_fd, int out_fd) {
+    int show[3] = { 0, 0, 0 };
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        for(const char *f = argv[i] + 1; *f; f++) {
+            if(*f == 'l') show[0] = 1;
+            else if(*f == 'w') show[1] = 1;
+            else if(*f == 'c') show[2] = 1;
+            else {
+                dprintf(STDERR_FILENO, "wc: invalid option -- '%c'\n", *f);
+                return 1;
+            }
+        }
+    }
+    if(!show[0] && !show[1] && !show[2]) {
+        show[0] = show[1] = show[2] = 1;
+    }
+
+    int files = argc - i;
+    int slots = files ? files : 1;
+    uint64_t (*counts)[3] = arena_alloc(&line_arena, (size_t)slots * sizeof(*counts));
+    int *ok = arena_alloc(&line_arena, (size_t)slots * sizeof(*ok));
+    uint64_t total[3] = { 0, 0, 0 };
+    int status = 0;
+    int piped = 0;
+    for(int f = 0; f < (files ? files : 1); f++) {
+        const char *name = files ? argv[i + f] : "-";
+        int fd = in_fd;
+        if(strcmp(name, "-") != 0) {
+            fd = open(name, O_RDONLY | O_CLOEXEC);
+        }
+        struct stat st;
+        if(fd >= 0 && fstat(fd, &st) == 0 && !S_ISREG(st.st_mode)) piped = 1;
+        ok[f] = fd >= 0 && wc_fd(fd, counts[f]) == 0;
+        if(!ok[f]) {
+            util_error("wc", name);
+            status = 1;
+        } else {
+            for(int c = 0; c < 3; c++) total[c] += counts[f][c];
+        }
+        if(fd >= 0 && fd != in_fd) close(fd);
+    }
+
+    // columns share the width of the largest number, like coreutils; a
+    // single column is unpadded and non-file input gets at least 7
+    int columns = show[0] + show[1] + show[2];
+    int width = 1;
+    if(columns > 1 || files > 1) {
+        for(uint64_t v = total[2] > total[1] ? (total[2] > total[0] ? total[2] : total[0])
+                                             : (total[1] > total[0] ? total[1] : total[0]);
+            v >= 10; v /= 10) {
+            width = width + 1;
+        }
+        if(piped && width < 7) width = 7;
+    }
+
+    for(int f = 0; f < (files ? files : 1); f++) {
+        if(ok[f]) wc_print(out_fd, counts[f], show, width, files ? argv[i + f] : NULL);
+    }
+    if(files > 1) wc_print(out_fd, total, show, width, "total");
+    return status;
+}
+
+// The accepts_* helpers tell whether an argv uses only what the in-process
+// version implements; any other option (cat -n, wc -m, echo -e, ...) leaves
+// the command to the system program.
+
+// helper to tell whether argv[from..] are all operands, "-" included
+static int plain_operands(int argc, char *argv[], int from) {
+    for(int i = from; i < argc; i++) {
+        if(argv[i][0] == '-' && argv[i][1] != '\0') return 0;
+    }
+    return 1;
+}
+
+static int accepts_any(int argc, char *argv[]) {
+    (void)argc; (void)argv;
+    return 1;
+}
+
+// helper to tell whether word is an option group echo would take, like -e or -nE
+static int echo_option(const char *word) {
+    if(word[0] != '-' || word[1] == '\0') return 0;
+    return word[strspn(word + 1, "neE") + 1] == '\0';
+}
+
+static int accepts_echo(int argc, char *argv[]) {
+    int first = 1;
+    if(argc > 1 && strcmp(argv[1], "-n") == 0) first = 2;
+    if(argc > first && echo_option(argv[first])) return 0;
+    return !(argc == 2 && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "--version") == 0));
+}
+
+static int accepts_cat(int argc, char *argv[]) {
+    return plain_operands(argc, argv, 1);
+}
+
+static int accepts_head(int argc, char *argv[]) {
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        const char *value = NULL;
+        if(argv[i][1] == 'n' || argv[i][1] == 'c') {
+            value = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : NULL);
+        } else {
+            value = argv[i] + 1;
+        }
+        if(value == NULL || util_number(value) < 0) return 0;
+    }
+    return plain_operands(argc, argv, i);
+}
+
+// Only line and byte counts: coreutils splits words by the locale's
+// isspace/isprint, which the # word rule does not follow, so plain wc and
+// wc -w go to the system program
+static int accepts_wc(int argc, char *argv[]) {
+    int i = 1;
+    for(; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if(argv[i][strspn(argv[i] + 1, "lc") + 1] != '\0') return 0;
+    }
+    return i > 1 && plain_operands(argc, argv, i);
+}
+
+// Table of in-process utilities
+struct utility {
+    const char *name;
+    int (*run)(int argc, char *argv[], int in_fd, int out_fd);
+    int (*accepts)(int argc, char *argv[]);
+};
+
+struct utility utilities[] = {
+    { "echo", util_echo, accepts_echo },
+    { "cat", util_cat, accepts_cat },
+    { "true", util_true, accepts_any },
+    { "false", util_false, accepts_any },
+    { "head", util_head, accepts_head },
+    { "wc", util_wc, accepts_wc },
+};
+#define NUM_UTILITIES ((int)(sizeof(utilities) / sizeof(utilities[0])))
+
+// helper to look a command up in the utility table, -1 if absent or if it
+// uses an option only the system program has
+static int find_utility(int argc, char *argv[]) {
+    for(int i = 0; i < NUM_UTILITIES; i++) {
+        if(strcmp(argv[0], utilities[i].name) == 0) return utilities[i].accepts(argc, argv) ? i : -1;
+    }
+    return -1;
+}
+
+// helper to open a file operand; "-" stands for the stage's input
+static int open_operand(const char *name, int in_fd) {
+    if(strcmp(name, "-") == 0) return in_fd;
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        printf("Failed to open file %s\n", name);
+    }
+    return fd;
+}
+
+// 6. Word count for text file, or for the stage input when no file (or -)
+// is given, so "ls | #" works as a pipeline stage
+int file_wordcount(char *tokens[], int num_tokens, int in_fd, int out_fd) {
+    // Validate arguments
+    if(num_tokens > 2) {
+        printf("Command argc must be 2\n");
+        return 1;
+    }
+
+    // opening the file - argc 1
+    char *filename = num_tokens == 2 ? tokens[1] : "-";
+    int fd = open_operand(filename, in_fd);
+    if(fd < 0) return 1;
+
+    // Count words; the total is 64-bit so multi-GB inputs cannot overflow
+    uint64_t word_count = 0;
+    int result = fd != in_fd ? wordcount_cached(fd, &word_count) : wordcount_input(fd, &word_count);
+    if(fd != in_fd) close(fd);
+    if(result < 0) {
+        printf("Failed to read file %s\n", filename);
+        return 1;
+    }
+    dprintf(out_fd, "Total word count is: %" PRIu64 "\n", word_count);
+    return 0;
+}
+
+// 7. File concatenation to the stage output; a - operand copies the input
+int file_concat(char *tokens[], int num_tokens, int in_fd, int out_fd) {
+    // Count number of files
+    int file_count = 0;
+
+    for(int i=0; i<num_tokens; i++) {
+        if(strcmp(tokens[i], "+") != 0) {
+            // files will be 1 more than the + operators
+            file_count = file_count + 1;
+        }
+    }
+
+    // Validate file count
+    if(file_count < 2) {
+        printf("Need at least 2 files\n");
+        return 1;
+    }
+
+    // the prompt and earlier messages must reach fd 1 before the file data
+    fflush(stdout);
+
+    // Copy each file to the output
+    int status = 0;
+    for(int i=0; i<num_tokens; i++) {
+        if(strcmp(tokens[i], "+") == 0) continue;
+        int fd = open_operand(tokens[i], in_fd);
+        if(fd < 0) {
+            fflush(stdout);
+            status = 1;
+            continue;
+        }
+
+        if(copy_data(fd, out_fd, COPY_ALL) < 0) {
+            printf("Failed to copy file %s: %s\n", tokens[i], strerror(errno));
+            fflush(stdout);
+            status = 1;
+        }
+        if(fd != in_fd) close(fd);
+    }
+    return status;
+}
+
+// 8. File append operation; only the status message goes to the output
+int file_append(char *tokens[], int num_tokens, int in_fd, int out_fd) {
+    (void)in_fd;
+    if(num_tokens != 3) {
+        printf("Few/many arguments received\n");
+        return 1;
+    }
+
+    // Check if middle token is ++
+    if(strcmp(tokens[1], "++") != 0) {
+        printf("Invalid format for file append\n");
+        return 1;
+    }
+
+    char *file1 = tokens[0];
+    char *file2 = tokens[2];
+
+    // Separate read and write descriptions so each keeps its own offset
+    int rd1 = open(file1, O_RDONLY);
+    if(rd1 < 0) {
+        printf("Failed to open file %s\n", file1);
+        return 1;
+    }
+    int rd2 = open(file2, O_RDONLY);
+    if(rd2 < 0) {
+        printf("Failed to open file %s\n", file2);
+        close(rd1);
+        return 1;
+    }
+
+    // Snapshot the original lengths; each side gets exactly the other's
+    // original bytes however the files grow while copying
+    struct stat st1, st2;
+    if(fstat(rd1, &st1) < 0 || fstat(rd2, &st2) < 0) {
+        printf("Failed to read file sizes\n");
+        close(rd1);
+        close(rd2);
+        return 1;
+    }
+
+    int wr1 = open(file1, O_WRONLY);
+    if(wr1 < 0) {
+        printf("Failed to open file %s for writing\n", file1);
+        close(rd1);
+        close(rd2);
+        return 1;
+    }
+    int wr2 = open(file2, O_WRONLY);
+    if(wr2 < 0) {
+        printf("Failed to open file %s for writing\n", file2);
+        close(rd1);
+        close(rd2);
+        close(wr1);
+        return 1;
+    }
+
+    // Writes are positioned at the current end rather than through O_APPEND,
+    // which copy_file_range and sendfile refuse. Seeking after the first copy
+    // also keeps "a ++ a" appending twice, as the buffered version did.
+    int failed = 0;
+    if(lseek(wr1, 0, SEEK_END) < 0 || copy_data(rd2, wr1, (uint64_t)st2.st_size) < 0) {
+        printf("Failed to append %s to %s: %s\n", file2, file1, strerror(errno));
+        failed = 1;
+    } else if(lseek(wr2, 0, SEEK_END) < 0 || copy_data(rd1, wr2, (uint64_t)st1.st_size) < 0) {
+        printf("Failed to append %s to %s: %s\n", file1, file2, strerror(errno));
+        failed = 1;
+    }
+
+    close(rd1);
+    close(rd2);
+    close(wr1);
+    close(wr2);
+
+    if(!failed) {
+        dprintf(out_fd, "Files appended successfully\n");
+    }
+    return failed;
+}
+
+// helper function to check for file operations and run the matching one
+// between in_fd and out_fd; returns its status
+int check_file_ops(char *tokens[], int num_tokens, int in_fd, int out_fd) {
+    // Check for word count operator
+    if(strcmp(tokens[0], "#") == 0) {
+        return file_wordcount(tokens, num_tokens, in_fd, out_fd);
+    }
+
+    // Check for file append
+    for(int i=0; i<num_tokens; i++) {
+        if(strcmp(tokens[i], "++") == 0) {
+            return file_append(tokens, num_tokens, in_fd, out_fd);
+        }
+    }
+
+    // Check for file concatenation
+    return file_concat(tokens, num_tokens, in_fd, out_fd);
+}
+
+// 16. Show or reset the command path cache
+void handle_hash(char *tokens[], int num_tokens) {
+    if(num_tokens == 2) {
+        if(strcmp(tokens[1], "-r") != 0) {
+            printf("Usage: hash [-r]\n");
             return;
         }
+        path_cache_clear();
+        return;
+    }
+
+    if(path_cache_count == 0) {
+        printf("hash: hash table empty\n");
+        return;
+    }
+    printf("hits\tcommand\n");
+    for(int i = 0; i < PATH_CACHE_SIZE; i++) {
+        if(path_cache[i].state == 1) {
+            printf("%4d\t%s\n", path_cache[i].hits, path_cache[i].path);
+        }
+    }
+}
+
+/* ======Shell Options====== */
+
+int opt_pipefail = 0;       // pipeline fails if any stage fails, not just the last
+int opt_utilities = 1;      // run echo, cat, true, false, head and wc in-process
+int opt_bigpipe = 0;        // size every pipeline's pipes up to the system maximum
+int opt_pin = 0;            // pin the stages of every pipeline to CPUs
+
+// Options toggled with set -o / set +o
+struct shell_option {
+    const char *name;
+    int *value;
+};
+
+struct shell_option shell_options[] = {
+    { "pipefail", &opt_pipefail },
+    { "utilities", &opt_utilities },
+    { "bigpipe", &opt_bigpipe },
+    { "trace", &opt_trace },
+    { "pin", &opt_pin },
+};
+#define NUM_OPTIONS ((int)(sizeof(shell_options) / sizeof(shell_options[0])))
+
+// 19. Show options, or turn one on (set -o name) or off (set +o name)
+int handle_set(char *tokens[], int num_tokens) {
+    if(num_tokens == 1) {
+        for(int i = 0; i < NUM_OPTIONS; i++) {
+            printf("%-12s %s\n", shell_options[i].name, *shell_options[i].value ? "on" : "off");
+        }
+        return 0;
+    }
+    if(num_tokens != 3 || (strcmp(tokens[1], "-o") != 0 && strcmp(tokens[1], "+o") != 0)) {
+        printf("Usage: set [-o|+o option]\n");
+        return 1;
+    }
+    for(int i = 0; i < NUM_OPTIONS; i++) {
+        if(strcmp(tokens[2], shell_options[i].name) == 0) {
+            *shell_options[i].value = (tokens[1][0] == '-');
+            return 0;
+        }
+    }
+    printf("set: unknown option %s\n", tokens[2]);
+    return 1;
+}
+
+int parallel_jobs = 0;      // ::: pool size, 0 for one per usable CPU
+
+// helper to return how many ::: lists may run at once
+static int parallel_limit(void) {
+    if(parallel_jobs > 0) return parallel_jobs;
+    cpu_set_t set;
+    if(sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) return CPU_COUNT(&set);
+    return 1;
+}
+
+// 24. Show the ::: pool size, or set it with parallel -j N (0: one per CPU)
+int handle_parallel(char *tokens[], int num_tokens) {
+    if(num_tokens == 1) {
+        printf("Parallel jobs: %d%s\n", parallel_limit(), parallel_jobs == 0 ? " (one per CPU)" : "");
+        return 0;
+    }
+    char *end;
+    long jobs = num_tokens == 3 ? strtol(tokens[2], &end, 10) : -1;
+    if(num_tokens != 3 || strcmp(tokens[1], "-j") != 0 || *end != '\0' || jobs < 0 || jobs > INT_MAX) {
+        printf("Usage: parallel [-j N]\n");
+        return 1;
+    }
+    parallel_jobs = (int)jobs;
+    return 0;
+}
+
+/* ======CPU Pinning====== */
+
+// taskset -c LIST in front of a command pins it to those CPUs; set -o pin
+// spreads the stages of every multi-stage pipeline one CPU each over the
+// CPUs the shell may use. Those are taken in topology order (package, then
+// core), so adjacent stages land on SMT siblings or neighbouring cores of
+// one package and the data passed between them stays in shared cache.
+struct cpu_place {
+    int package;
+    int core;
+    int cpu;
+};
+
+int pin_order[CPU_SETSIZE];     // usable CPUs in topology order
+int pin_count = 0;
+int pin_next = 0;               // first CPU of the next pipeline, rotates
+
+// helper to read one topology number of a CPU from sysfs, 0 if unknown
+static int cpu_topology(int cpu, const char *name) {
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return 0;
+    char buf[32];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if(n <= 0) return 0;
+    buf[n] = '\0';
+    return atoi(buf);
+}
+
+// helper for sorting CPUs by package, core and number
+static int cpu_place_compare(const void *a, const void *b) {
+    const struct cpu_place *x = a, *y = b;
+    if(x->package != y->package) return x->package - y->package;
+    if(x->core != y->core) return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+// helper to build pin_order on first use
+static void pin_init(void) {
+    cpu_set_t set;
+    if(pin_count > 0 || sched_getaffinity(0, sizeof(set), &set) != 0) return;
+    static struct cpu_place places[CPU_SETSIZE];
+    int count = 0;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if(!CPU_ISSET(cpu, &set)) continue;
+        places[count].package = cpu_topology(cpu, "physical_package_id");
+        places[count].core = cpu_topology(cpu, "core_id");
+        places[count].cpu = cpu;
+        count = count + 1;
+    }
+    qsort(places, count, sizeof(places[0]), cpu_place_compare);
+    for(int i = 0; i < count; i++) pin_order[i] = places[i].cpu;
+    pin_count = count;
+}
+
+// helper to parse a CPU list such as 0-3,6 into set. Returns -1 if the
+// list is malformed or names no CPU.
+int parse_cpu_list(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *p = list;
+    while(*p != '\0') {
+        char *end;
+        long low = strtol(p, &end, 10);
+        long high = low;
+        if(end == p) return -1;
+        if(*end == '-') {
+            p = end + 1;
+            high = strtol(p, &end, 10);
+            if(end == p) return -1;
+        }
+        if(low < 0 || high < low || high >= CPU_SETSIZE) return -1;
+        for(long cpu = low; cpu <= high; cpu++) CPU_SET(cpu, set);
+        p = end;
+        if(*p == ',') {
+            p++;
+        } else if(*p != '\0') {
+            return -1;
+        }
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/* ======Lexer and Parser====== */
+
+// Operator codes assigned to every token by the lexer
+enum token_code {
+    TOK_WORD, TOK_PIPE, TOK_RPIPE, TOK_AND, TOK_OR, TOK_SEMI, TOK_BG,
+    TOK_IN, TOK_OUT, TOK_APPEND, TOK_HASH, TOK_PLUS, TOK_PLUSPLUS, TOK_BIGPIPE, TOK_PARALLEL,
+    TOK_END
+};
+
+enum cmd_kind { CMD_EXEC, CMD_BUILTIN, CMD_FILEOP, CMD_UTILITY };
+
+// one command with its own redirections
+struct cmd_node {
+    int kind;
+    char **argv;        // NULL terminated, points into line_ast.argv_pool
+    int argc;
+    char *in_file;      // < target or NULL
+    char *out_file;     // > or >> target or NULL
+    int out_append;
+    int builtin;        // builtin table index for CMD_BUILTIN
+    int utility;        // utility table index for CMD_UTILITY
+    int nice;           // from a nice -n N prefix, applied by the shell
+    cpu_set_t *cpus;    // from a taskset -c LIST prefix, NULL when not pinned
+};
+
+// commands joined by | (or ~, already stored in run order)
+struct pipe_node {
+    int first_cmd;
+    int cmd_count;
+    int next_op;        // TOK_AND or TOK_OR before the next pipeline, TOK_END if last
+    int big_pipes;      // joined with |+ somewhere: use maximum pipe capacity
+};
+
+// pipelines joined by && and ||, ended by ; & or the end of the line
+struct andor_node {
+    int first_pipe;
+    int pipe_count;
+    int background;
+    int parallel;       // joined to the next list by :::
+};
+
+// Whole parsed line. The arrays come from the line arena, sized for the
+// worst case the line's length allows, and the words point into the line
+// itself, so parsing never allocates per token or per node.
+struct line_ast {
+    char **words;
+    unsigned char *codes;
+    int num_tokens;
+    char **argv_pool;
+    int argv_used;
+    struct cmd_node *cmds;
+    int cmd_count;
+    struct pipe_node *pipes;
+    int pipe_count;
+    struct andor_node *andors;
+    int andor_count;
+    int timed;          // line started with time
+};
+
+// Array of valid commands
+const char *builtin_names[] = {
+    "killterm", "killallterms", "numbg", "killbp", "exit", "hash", "jobs", "wait",
+    "set", "pipestatus", "pipesize", "trace", "parallel", "bglimit", "wccache", "audit"
+};
+// Maximum tokens each command accepts, including its name
+const int builtin_max_tokens[] = { 1, 1, 1, 1, 1, 2, 1, 2, 3, 1, 1, 2, 3, 2, 3, 3 };
+#define NUM_BUILTINS ((int)(sizeof(builtin_names) / sizeof(builtin_names[0])))
+
+// helper to look a command name up in the builtin table, -1 if absent
+static int find_builtin(const char *name) {
+    for(int i = 0; i < NUM_BUILTINS; i++) {
+        if(strcmp(name, builtin_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// helper to map a token to its operator code without any strcmp
+static int classify_token(const char *t) {
+    switch(t[0]) {
+    case '|': return t[1] == '\0' ? TOK_PIPE : (t[1] == '|' && t[2] == '\0') ? TOK_OR
+                   : (t[1] == '+' && t[2] == '\0') ? TOK_BIGPIPE : TOK_WORD;
+    case '&': return t[1] == '\0' ? TOK_BG : (t[1] == '&' && t[2] == '\0') ? TOK_AND : TOK_WORD;
+    case '>': return t[1] == '\0' ? TOK_OUT : (t[1] == '>' && t[2] == '\0') ? TOK_APPEND : TOK_WORD;
+    case '+': return t[1] == '\0' ? TOK_PLUS : (t[1] == '+' && t[2] == '\0') ? TOK_PLUSPLUS : TOK_WORD;
+    case ';': return t[1] == '\0' ? TOK_SEMI : TOK_WORD;
+    case '~': return t[1] == '\0' ? TOK_RPIPE : TOK_WORD;
+    case '<': return t[1] == '\0' ? TOK_IN : TOK_WORD;
+    case '#': return t[1] == '\0' ? TOK_HASH : TOK_WORD;
+    case ':': return (t[1] == ':' && t[2] == ':' && t[3] == '\0') ? TOK_PARALLEL : TOK_WORD;
+    }
+    return TOK_WORD;
+}
+
+// helper to split input on spaces in place and classify each token as it is
+// cut, so the line is walked exactly once. A line of len bytes holds at most
+// (len + 1) / 2 tokens, which sizes every array of the parse.
+static void lex_line(char *input, size_t len, struct line_ast *ast) {
+    size_t max_tokens = (len + 1) / 2 + 1;
+    ast->words = arena_alloc(&line_arena, max_tokens * sizeof(char *));
+    ast->codes = arena_alloc(&line_arena, max_tokens);
+    int n = 0;
+    char *p = input;
+
+    while(1) {
+        while(*p == ' ') p++;
+        if(*p == '\0') break;
+        ast->words[n] = p;
+        while(*p != ' ' && *p != '\0') p++;
+        if(*p == ' ') *p++ = '\0';
+        ast->codes[n] = (unsigned char)classify_token(ast->words[n]);
+        n = n + 1;
+    }
+    ast->num_tokens = n;
+    ast->words[n] = NULL;
+    ast->codes[n] = TOK_END;
+
+    // every command, pipeline and list needs at least one token, and each
+    // argv at most its words plus a NULL
+    ast->argv_pool = arena_alloc(&line_arena, (size_t)(2 * n + 1) * sizeof(char *));
+    ast->cmds = arena_alloc(&line_arena, (size_t)(n + 1) * sizeof(struct cmd_node));
+    ast->pipes = arena_alloc(&line_arena, (size_t)(n + 1) * sizeof(struct pipe_node));
+    ast->andors = arena_alloc(&line_arena, (size_t)(n + 1) * sizeof(struct andor_node));
+}
+
+// helper to parse one command and its redirections starting at *pos
+static int parse_command(struct line_ast *ast, int *pos) {
+    struct cmd_node *cmd = &ast->cmds[ast->cmd_count];
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->argv = &ast->argv_pool[ast->argv_used];
+    int is_fileop = 0;
+
+    while(1) {
+        int code = ast->codes[*pos];
+        if(code == TOK_WORD || code == TOK_PLUS || code == TOK_PLUSPLUS
+                || (code == TOK_HASH && cmd->argc > 0)) {
+            // + and ++ anywhere, or # in front, make this a file operation
+            if(code == TOK_PLUS || code == TOK_PLUSPLUS) is_fileop = 1;
+            cmd->argv[cmd->argc++] = ast->words[(*pos)++];
+        } else if(code == TOK_HASH) {
+            is_fileop = 1;
+            cmd->argv[cmd->argc++] = ast->words[(*pos)++];
+        } else if(code == TOK_IN || code == TOK_OUT || code == TOK_APPEND) {
+            // 9-11. Redirection operators need a file name right after them
+            if(ast->codes[*pos + 1] != TOK_WORD) {
+                printf("%s\n", code == TOK_IN ? "Invalid input redirection syntax"
+                             : code == TOK_OUT ? "Invalid output redirection syntax"
+                             : "Invalid append redirection syntax");
+                return -1;
+            }
+            if(code == TOK_IN) {
+                cmd->in_file = ast->words[*pos + 1];
+            } else {
+                cmd->out_file = ast->words[*pos + 1];
+                cmd->out_append = (code == TOK_APPEND);
+            }
+            *pos += 2;
+        } else {
+            break;
+        }
+    }
+    cmd->argv[cmd->argc] = NULL;
+    ast->argv_used += cmd->argc + 1;
+
+    // nice -n N is taken by the shell so a queued job can be ordered by it,
+    // and taskset -c LIST so pinning needs no extra process; the launched
+    // command ends up as nice(1) or taskset(1) would have left it
+    while(!is_fileop && cmd->argc > 3) {
+        char *end;
+        if(strcmp(cmd->argv[0], "nice") == 0 && strcmp(cmd->argv[1], "-n") == 0) {
+            long nice = strtol(cmd->argv[2], &end, 10);
+            if(*end != '\0' || end == cmd->argv[2] || nice < -40 || nice > 40) break;
+            cmd->nice = (int)nice;
+        } else if(strcmp(cmd->argv[0], "taskset") == 0 && strcmp(cmd->argv[1], "-c") == 0) {
+            cmd->cpus = arena_alloc(&line_arena, sizeof(cpu_set_t));
+            if(parse_cpu_list(cmd->argv[2], cmd->cpus) < 0) {
+                printf("taskset: invalid CPU list %s\n", cmd->argv[2]);
+                return -1;
+            }
+        } else {
+            break;
+        }
+        cmd->argv += 3;
+        cmd->argc -= 3;
+    }
+
+    if(is_fileop) {
+        cmd->kind = CMD_FILEOP;
+    } else {
+        // Validate argc for this command
+        if(cmd->argc < 1) {
+            printf("Missing command\n");
+            return -1;
+        }
+        cmd->builtin = find_builtin(cmd->argv[0]);
+        if(cmd->builtin >= 0) {
+            if(cmd->argc > builtin_max_tokens[cmd->builtin]) {
+                printf("Few/many arguments received\n");
+                return -1;
+            }
+            if(cmd->in_file || cmd->out_file) {
+                printf("Builtin %s cannot be redirected\n", cmd->argv[0]);
+                return -1;
+            }
+            cmd->kind = CMD_BUILTIN;
+        } else if(opt_utilities && (cmd->utility = find_utility(cmd->argc, cmd->argv)) >= 0) {
+            cmd->kind = CMD_UTILITY;
+        }
+    }
+    ast->cmd_count = ast->cmd_count + 1;
+    return 0;
+}
+
+// helper to parse commands joined by | or by ~
+static int parse_pipeline(struct line_ast *ast, int *pos) {
+    struct pipe_node *pl = &ast->pipes[ast->pipe_count++];
+    pl->first_cmd = ast->cmd_count;
+    pl->next_op = TOK_END;
+    pl->big_pipes = 0;
+    if(parse_command(ast, pos) < 0) return -1;
+
+    // |+ is a | that asks for big pipes for the whole pipeline
+    int link = TOK_END;
+    while(ast->codes[*pos] == TOK_PIPE || ast->codes[*pos] == TOK_BIGPIPE
+            || ast->codes[*pos] == TOK_RPIPE) {
+        int code = ast->codes[(*pos)++];
+        if(code == TOK_BIGPIPE) {
+            pl->big_pipes = 1;
+            code = TOK_PIPE;
+        }
+        if(link != TOK_END && code != link) {
+            printf("Cannot mix | and ~ in one pipeline\n");
+            return -1;
+        }
+        link = code;
+        if(parse_command(ast, pos) < 0) return -1;
+    }
+    pl->cmd_count = ast->cmd_count - pl->first_cmd;
+
+    if(pl->cmd_count > 1) {
+        for(int c = pl->first_cmd; c < ast->cmd_count; c++) {
+            if(ast->cmds[c].kind == CMD_BUILTIN) {
+                printf("Builtin %s cannot be used in a pipeline\n", ast->cmds[c].argv[0]);
+                return -1;
+            }
+        }
+    }
+
+    // 14. reverse pipe: store the stages in the order they will run
+    if(link == TOK_RPIPE) {
+        int left = pl->first_cmd;
+        int right = ast->cmd_count - 1;
+        while(left < right) {
+            struct cmd_node temp = ast->cmds[left];
+            ast->cmds[left] = ast->cmds[right];
+            ast->cmds[right] = temp;
+            left = left + 1;
+            right = right - 1;
+        }
+    }
+    return 0;
+}
+
+// helper to parse pipelines joined by && and ||
+static int parse_andor(struct line_ast *ast, int *pos) {
+    struct andor_node *andor = &ast->andors[ast->andor_count++];
+    andor->first_pipe = ast->pipe_count;
+    andor->background = 0;
+    andor->parallel = 0;
+    if(parse_pipeline(ast, pos) < 0) return -1;
+
+    while(ast->codes[*pos] == TOK_AND || ast->codes[*pos] == TOK_OR) {
+        ast->pipes[ast->pipe_count - 1].next_op = ast->codes[(*pos)++];
+        if(parse_pipeline(ast, pos) < 0) return -1;
+    }
+    andor->pipe_count = ast->pipe_count - andor->first_pipe;
+    return 0;
+}
+
+// helper to lex and parse a whole line of len bytes into ast. Returns -1
+// after printing an error, in which case nothing on the line is run.
+int parse_line(char *input, size_t len, struct line_ast *ast) {
+    ast->argv_used = 0;
+    ast->cmd_count = 0;
+    ast->pipe_count = 0;
+    ast->andor_count = 0;
+    lex_line(input, len, ast);
+
+    // 22. time in front of a line times everything on it
+    int pos = 0;
+    ast->timed = ast->num_tokens > 0 && strcmp(ast->words[0], "time") == 0;
+    if(ast->timed) pos = 1;
+    while(pos < ast->num_tokens) {
+        if(parse_andor(ast, &pos) < 0) return -1;
+
+        // ; separates lists, & also sends the list before it to the background
+        // and ::: joins it to the next one in a parallel group
+        int code = ast->codes[pos];
+        struct andor_node *prev = ast->andor_count > 1 ? &ast->andors[ast->andor_count - 2] : NULL;
+        if(code == TOK_BG && prev != NULL && prev->parallel) {
+            printf("Cannot run a ::: group in the background\n");
+            return -1;
+        }
+        if(code == TOK_SEMI || code == TOK_BG || code == TOK_PARALLEL) {
+            ast->andors[ast->andor_count - 1].background = (code == TOK_BG);
+            ast->andors[ast->andor_count - 1].parallel = (code == TOK_PARALLEL);
+            pos = pos + 1;
+            if(code == TOK_PARALLEL && ast->codes[pos] == TOK_END) {
+                printf("Missing command after :::\n");
+                return -1;
+            }
+        } else if(code != TOK_END) {
+            printf("Unexpected %s\n", ast->words[pos]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* ======Executors====== */
+
+int exit_requested = 0;     // set by the exit builtin, checked after each list
+int last_status = 0;        // status of the last pipeline, the shell's exit status
+
+// helper to turn a wait status into a shell exit status
+static int exit_status(int status) {
+    if(WIFEXITED(status)) return WEXITSTATUS(status);
+    if(WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+// helper to open a command's redirection targets in the shell, so a bad
+// path is reported before launching. Returns -1 if any open failed.
+static int open_redirections(struct cmd_node *cmd, struct launch_io *redir) {
+    redir->in_fd = -1;
+    redir->out_fd = -1;
+    if(cmd->in_file == NULL && cmd->out_file == NULL) return 0;
+    TRACE_BEGIN(start);
+
+    // 9. Input redirection
+    if(cmd->in_file != NULL) {
+        redir->in_fd = open(cmd->in_file, O_RDONLY | O_CLOEXEC);
+        if(redir->in_fd < 0) {
+            printf("Failed to open file %s\n", cmd->in_file);
+            TRACE_END(start, "redirect", -1L);
+            return -1;
+        }
+    }
+
+    // 10. Output redirection, 11. Append output redirection
+    if(cmd->out_file != NULL) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (cmd->out_append ? O_APPEND : O_TRUNC);
+        redir->out_fd = open(cmd->out_file, flags, 0644);
+        if(redir->out_fd < 0) {
+            printf("Failed to open file %s\n", cmd->out_file);
+            if(redir->in_fd >= 0) close(redir->in_fd);
+            redir->in_fd = -1;
+            TRACE_END(start, "redirect", -1L);
+            return -1;
+        }
     }
-    
-    // Parent process - close all pipes
-    for(int p=0; p<cmd_count-1; p++) {
-        close(pipes[p][0]);
-        close(pipes[p][1]);
+    TRACE_END(start, "redirect", 0);
+    return 0;
+}
+
+/* ======Timing====== */
+
+// A line starting with time reports, on stderr, the wall clock and rusage
+// of every stage of every pipeline it runs, each pipeline as a whole and,
+// when there is more than one, the whole line. Children are measured by
+// the wait that reaps them, in-process commands by getrusage around them.
+struct stage_usage {
+    struct rusage ru;
+    struct timespec end;    // when the stage was reaped
+};
+
+int time_line = 0;              // the running line is timed
+struct rusage time_line_usage;  // summed over every pipeline of the line
+int time_line_pipes = 0;
+
+// helper to return the seconds elapsed since start
+static double elapsed_since(const struct timespec *start, const struct timespec *end) {
+    struct timespec now;
+    if(end == NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        end = &now;
     }
-    
-    // Wait for all children
-    for(int c=0; c<cmd_count; c++) {
-        wait(NULL);
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// helper to turn a timeval into seconds
+static double tv_seconds(const struct timeval *tv) {
+    return (double)tv->tv_sec + (double)tv->tv_usec / 1e6;
+}
+
+// helper to add ru to sum; the peak RSS is the largest seen, not a sum
+static void usage_add(struct rusage *sum, const struct rusage *ru) {
+    timeradd(&sum->ru_utime, &ru->ru_utime, &sum->ru_utime);
+    timeradd(&sum->ru_stime, &ru->ru_stime, &sum->ru_stime);
+    if(ru->ru_maxrss > sum->ru_maxrss) sum->ru_maxrss = ru->ru_maxrss;
+    sum->ru_minflt += ru->ru_minflt;
+    sum->ru_majflt += ru->ru_majflt;
+    sum->ru_nvcsw += ru->ru_nvcsw;
+    sum->ru_nivcsw += ru->ru_nivcsw;
+}
+
+// helper to turn two getrusage samples of the shell into the cost of what
+// ran between them; the peak RSS stays the shell's own
+static void usage_delta(struct rusage *ru, const struct rusage *before, const struct rusage *after) {
+    memset(ru, 0, sizeof(*ru));
+    timersub(&after->ru_utime, &before->ru_utime, &ru->ru_utime);
+    timersub(&after->ru_stime, &before->ru_stime, &ru->ru_stime);
+    ru->ru_maxrss = after->ru_maxrss;
+    ru->ru_minflt = after->ru_minflt - before->ru_minflt;
+    ru->ru_majflt = after->ru_majflt - before->ru_majflt;
+    ru->ru_nvcsw = after->ru_nvcsw - before->ru_nvcsw;
+    ru->ru_nivcsw = after->ru_nivcsw - before->ru_nivcsw;
+}
+
+// helper to print one report line
+static void usage_print(const char *label, double real, const struct rusage *ru) {
+    fflush(stdout);
+    dprintf(STDERR_FILENO,
+            "time %-16s real %.3fs user %.3fs sys %.3fs maxrss %ldKB majflt %ld minflt %ld "
+            "nvcsw %ld nivcsw %ld\n",
+            label, real, tv_seconds(&ru->ru_utime), tv_seconds(&ru->ru_stime), ru->ru_maxrss,
+            ru->ru_majflt, ru->ru_minflt, ru->ru_nvcsw, ru->ru_nivcsw);
+}
+
+// helper to report a finished pipeline: each stage when there are several,
+// then the pipeline, which is also added to the line's total
+static void time_report(struct cmd_node *cmds, struct stage_usage *usage, int count,
+                        const struct timespec *start) {
+    struct rusage total;
+    memset(&total, 0, sizeof(total));
+    char label[64];
+    for(int c = 0; c < count; c++) {
+        if(count > 1) {
+            snprintf(label, sizeof(label), "%d:%s", c + 1, cmds[c].argv[0]);
+            usage_print(label, elapsed_since(start, &usage[c].end), &usage[c].ru);
+        }
+        usage_add(&total, &usage[c].ru);
     }
+    usage_print(count > 1 ? "pipeline" : cmds[0].argv[0], elapsed_since(start, NULL), &total);
+    usage_add(&time_line_usage, &total);
+    time_line_pipes = time_line_pipes + 1;
 }
 
-// 14. Reverse pipe execution
-void revpipe(char *tokens[], int num_tokens) {
-    // Phase 1: Parse commands like normal pipe
-    char *cmds[MAX_COMMANDS][MAX_ARGS];
-    int cmd_lens[MAX_COMMANDS];
-    int cmd_count = 0;
-    
-    // Count reverse pipe operators
-    int rpipe_count = 0;
-    for(int i=0; i<num_tokens; i++) {
-        if(strcmp(tokens[i], "~") == 0) {
-            rpipe_count = rpipe_count + 1;
+/* ======Pipeline Waits====== */
+
+// statuses of the last foreground pipeline, one per stage, for pipestatus.
+// Kept outside the line arena since they must outlive the line.
+int *last_stage_status = NULL;
+char (*last_stage_name)[32] = NULL;     // copied, the line buffer is reused
+int last_stage_count = 0;
+int last_stage_cap = 0;
+
+// helper to remember the stage names and statuses of a finished pipeline
+static void record_stages(struct cmd_node *cmds, const int *statuses, int count) {
+    if(count > last_stage_cap) {
+        int *status = realloc(last_stage_status, (size_t)count * sizeof(*status));
+        if(status != NULL) last_stage_status = status;
+        char (*name)[32] = realloc(last_stage_name, (size_t)count * sizeof(*name));
+        if(name != NULL) last_stage_name = name;
+        if(status == NULL || name == NULL) {
+            last_stage_count = 0;
+            return;
         }
+        last_stage_cap = count;
     }
-    
-    // Validate max reverse pipes
-    if(rpipe_count > 5) {
-        printf("Maximum 5 reverse piping operations allowed\n");
-        return;
+    last_stage_count = count;
+    for(int c = 0; c < count; c++) {
+        last_stage_status[c] = statuses[c];
+        snprintf(last_stage_name[c], sizeof(last_stage_name[c]), "%s", cmds[c].argv[0]);
     }
-    
-    // Split tokens into command segments
-    int start = 0;
-    for(int i=0; i<=num_tokens; i++) {
-        if(i == num_tokens || strcmp(tokens[i], "~") == 0) {
-            int cmd_len = i - start;
-            
-            if(cmd_len < 1 || cmd_len > 5 || cmd_len == 0) {
-                printf("Each reverse piped command argc must be between 1 and 5\n");
-                return;
-            }
-            
-            // Store command
-            int j;
-            for(j=0; j<cmd_len; j++) {
-                cmds[cmd_count][j] = tokens[start + j];
+}
+
+// helper to reap whatever has exited without blocking. Pipeline stages are
+// recognised by pid and reaped through their own pidfd; anything else is
+// handed to the job table.
+static void reap_exited(pid_t *pids, int *pidfds, int *statuses, struct stage_usage *usage,
+                        int count, int *left) {
+    siginfo_t info;
+    while(1) {
+        // peek first so a stage is only ever reaped through its pidfd
+        memset(&info, 0, sizeof(info));
+        if(waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) < 0 || info.si_pid == 0) break;
+
+        int stage = -1;
+        for(int c = 0; c < count; c++) {
+            if(pids[c] == info.si_pid && pidfds[c] >= 0) stage = c;
+        }
+        if(stage < 0) {
+            // draining the signalfd ate this SIGCHLD, so start queued jobs here
+            int status;
+            if(waitpid(info.si_pid, &status, WNOHANG) > 0) {
+                job_finished(info.si_pid, status);
+                bg_dispatch();
             }
-            cmds[cmd_count][cmd_len] = NULL;
-            cmd_lens[cmd_count] = cmd_len;
-            cmd_count = cmd_count + 1; 
-            start = i + 1;
+            continue;
+        }
+        // the raw waitid also fills in the stage's rusage, like wait4
+        if(syscall(SYS_waitid, P_PIDFD, pidfds[stage], &info, WEXITED, &usage[stage].ru) == 0) {
+            statuses[stage] = info.si_code == CLD_EXITED ? info.si_status : 128 + info.si_status;
         }
+        clock_gettime(CLOCK_MONOTONIC, &usage[stage].end);
+        close(pidfds[stage]);
+        pidfds[stage] = -1;
+        *left = *left - 1;
     }
-    
-    // reversing the commands order for reversing pipe logic
+}
+
+// helper to wait for exactly the given stage pids. Each stage gets a pidfd
+// in one epoll set together with a signalfd for SIGCHLD, so background jobs
+// that finish meanwhile are reaped as they go instead of after the pipeline.
+// Must be called with SIGCHLD blocked. Falls back to wait4 per pid when
+// pidfds are unavailable. usage[] receives each stage's rusage and end time.
+static void wait_stages(pid_t *pids, int *statuses, struct stage_usage *usage, int count) {
+    TRACE_BEGIN(start);
+    static int epfd = -1, sigfd = -1;
+    int *pidfds = arena_alloc(&line_arena, (size_t)count * sizeof(int));
     int left = 0;
-    int right = cmd_count - 1;
-    while(left < right) {
-        // Swap commands at left and right positions
-        char *temp[MAX_ARGS];
-        int j;
-        
-        // Copy left to temp
-        for(j=0; j<=cmd_lens[left]; j++) {
-            temp[j] = cmds[left][j];
-        }
-        
-        // Copy right to left
-        for(j=0; j<=cmd_lens[right]; j++) {
-            cmds[left][j] = cmds[right][j];
-        }
-        
-        // Copy temp to right
-        for(j=0; j<=cmd_lens[left]; j++) {
-            cmds[right][j] = temp[j];
-        }
-        
-        // Swap lengths
-        int temp_len = cmd_lens[left];
-        cmd_lens[left] = cmd_lens[right];
-        cmd_lens[right] = temp_len;
-        
-        left = left + 1;
-        right = right - 1;
+
+    if(epfd < 0) {
+        sigset_t chld;
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        sigfd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+        if(epfd >= 0 && sigfd >= 0) {
+            struct epoll_event ev = { .events = EPOLLIN, .data.u32 = UINT32_MAX };
+            epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev);
+        }
     }
-    
-    // executing the normal logic of pipe
-    int pipes[cmd_count-1][2];
-    
-    // Create all pipes
-    for(int p=0; p<cmd_count-1; p++) {
-        if(pipe(pipes[p]) < 0) {
-            printf("Pipe creation failed\n");
-            return;
+
+    for(int c = 0; c < count; c++) {
+        pidfds[c] = -1;
+        memset(&usage[c], 0, sizeof(usage[c]));
+        if(pids[c] <= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &usage[c].end);
+            continue;
         }
+        if(epfd >= 0 && sigfd >= 0) pidfds[c] = open_pidfd(pids[c]);
+        if(pidfds[c] < 0) {
+            // no pidfd: wait for this pid directly
+            int status;
+            if(wait4(pids[c], &status, 0, &usage[c].ru) > 0) statuses[c] = exit_status(status);
+            clock_gettime(CLOCK_MONOTONIC, &usage[c].end);
+            continue;
+        }
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)c };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, pidfds[c], &ev);
+        left = left + 1;
     }
-    
-    // Fork all children
-    for(int c=0; c<cmd_count; c++) {
-        int fork_res = fork();
-        
-        if(fork_res == 0) {
-            // Connect input pipe if not first command
-            if(c > 0) {
-                dup2(pipes[c-1][0], STDIN_FILENO);
+
+    while(left > 0) {
+        // readiness only says something exited; reap_exited finds out what
+        struct epoll_event events[64];
+        int n = epoll_wait(epfd, events, 64, -1);
+        if(n < 0 && errno != EINTR) break;
+        for(int i = 0; i < n; i++) {
+            if(events[i].data.u32 == UINT32_MAX) {
+                // drain the queued SIGCHLD notifications
+                struct signalfd_siginfo si;
+                while(read(sigfd, &si, sizeof(si)) == sizeof(si)) {}
             }
-            
-            // Connect output pipe if not last command
-            if(c < cmd_count-1) {
-                dup2(pipes[c][1], STDOUT_FILENO);
+        }
+        reap_exited(pids, pidfds, statuses, usage, count, &left);
+    }
+    for(int c = 0; c < count; c++) {
+        if(pidfds[c] >= 0) close(pidfds[c]);
+    }
+    TRACE_END(start, "wait", (long)count);
+}
+
+int last_pipe_size = 0;     // capacity the last multi-stage pipeline got
+
+// helper to read the largest pipe an unprivileged process may ask for
+static int pipe_max_size(void) {
+    static int max_size = 0;
+    if(max_size == 0) {
+        max_size = 1 << 20;     // kernel default for pipe-max-size
+        int fd = open("/proc/sys/fs/pipe-max-size", O_RDONLY | O_CLOEXEC);
+        if(fd >= 0) {
+            char buf[32];
+            ssize_t n = read(fd, buf, sizeof(buf) - 1);
+            if(n > 0) {
+                buf[n] = '\0';
+                max_size = atoi(buf);
             }
-            
-            // Close all pipe file descriptors
-            for(int x=0; x<cmd_count-1; x++) {
+            close(fd);
+        }
+    }
+    return max_size;
+}
+
+// helper to grow a pipe as far as allowed. Past the per-user soft limit
+// the kernel refuses large sizes, so halve until one is accepted. Returns
+// the capacity the pipe ended up with.
+static int grow_pipe(int fd) {
+    for(int size = pipe_max_size(); size > 65536; size /= 2) {
+        if(fcntl(fd, F_SETPIPE_SZ, size) >= 0) break;
+    }
+    return fcntl(fd, F_GETPIPE_SZ);
+}
+
+// 21. Show the pipe capacity of the last pipeline and the system maximum
+void handle_pipesize(void) {
+    printf("Last pipeline pipe size: %d bytes (maximum %d, bigpipe %s)\n",
+           last_pipe_size, pipe_max_size(), opt_bigpipe ? "on" : "off");
+}
+
+// 20. Show the exit status of every stage of the last foreground pipeline
+void handle_pipestatus(void) {
+    for(int c = 0; c < last_stage_count; c++) {
+        printf("%d %s: %d\n", c + 1, last_stage_name[c], last_stage_status[c]);
+    }
+}
+
+// helper to run a builtin in the shell process
+static int run_builtin(struct cmd_node *cmd) {
+    switch (cmd->builtin + 1) {
+    case 1: // 1. Kill current terminal - killterm
+        handle_killterm(); break;
+
+    case 2: // 2. Kill all terminals - killallterms
+        handle_killallterms(); break;
+
+    case 3: // 3. Count bg processes - numbg
+        count_bg_processes(); break;
+
+    case 4: // 4. kill all process other than current and bash - killbp
+        kill_all_processes(); break;
+
+    case 5: // 5. Exit, with the status of the last pipeline
+        exit_requested = 1;
+        return last_status;
+
+    case 6: // 16. Path cache - hash / hash -r
+        handle_hash(cmd->argv, cmd->argc); break;
+
+    case 7: // 17. List background jobs - jobs
+        handle_jobs(); break;
+
+    case 8: // 18. Wait for background jobs - wait [pid | %job]
+        return handle_wait(cmd->argv, cmd->argc);
+
+    case 9: // 19. Shell options - set [-o|+o option]
+        return handle_set(cmd->argv, cmd->argc);
+
+    case 10: // 20. Stage statuses of the last pipeline - pipestatus
+        handle_pipestatus(); break;
+
+    case 11: // 21. Pipe capacity of the last pipeline - pipesize
+        handle_pipesize(); break;
+
+    case 12: // 23. Trace dump - trace [file | -c]
+        return handle_trace(cmd->argv, cmd->argc);
+
+    case 13: // 24. Parallel pool size - parallel [-j N]
+        return handle_parallel(cmd->argv, cmd->argc);
+
+    case 14: // 25. Background job limit - bglimit [N]
+        return handle_bglimit(cmd->argv, cmd->argc);
+
+    case 15: // 26. Word count cache - wccache [-c | -f file]
+        return handle_wccache(cmd->argv, cmd->argc);
+
+    case 16: // 27. Audit log - audit [-f file | -s]
+        return handle_audit(cmd->argv, cmd->argc);
+    }
+    return 0;
+}
+
+// helper to drop shell-only state in a forked copy of the shell: it owns
+// no jobs and is not a registered shell instance
+static void forked_child_reset(const sigset_t *old_mask) {
+    if(registry_fd >= 0) close(registry_fd);
+    registry_fd = -1;
+    signal(SIGTERM, SIG_DFL);
+    // a gate held open here would keep a queued job from seeing EOF
+    for(int i = 0; i < MAX_BG_JOBS; i++) {
+        if(job_table[i].state == JOB_QUEUED) close(job_table[i].gate_fd);
+    }
+    memset(job_table, 0, sizeof(job_table));
+    audit_enabled = 0;      // the writer thread stayed in the parent
+    bg_running = 0;
+    bg_queued = 0;
+    bg_done = 0;
+    bg_limit = 0;
+    jobs_unblock(old_mask);
+}
+
+// helper to run a utility or file operation between two fds in this process
+static int run_in_process(struct cmd_node *cmd, int in_fd, int out_fd) {
+    if(cmd->kind == CMD_FILEOP) {
+        return check_file_ops(cmd->argv, cmd->argc, in_fd, out_fd);
+    }
+    return utilities[cmd->utility].run(cmd->argc, cmd->argv, in_fd, out_fd);
+}
+
+// helper to run a utility or file operation as a pipeline stage in a forked
+// copy of the shell. The copy closes every pipe end except its own, since it never
+// execs and close-on-exec would not drop them.
+static pid_t fork_utility(struct cmd_node *cmd, int in_fd, int out_fd, int pipes[][2], int pipe_count,
+                          const sigset_t *old_mask) {
+    fflush(stdout);
+    TRACE_BEGIN(fork_start);
+    pid_t pid = fork();
+    if(pid == 0) {
+        forked_child_reset(old_mask);
+        for(int p = 0; p < pipe_count; p++) {
+            if(pipes[p][0] != in_fd) close(pipes[p][0]);
+            if(pipes[p][1] != out_fd) close(pipes[p][1]);
+        }
+        signal(SIGPIPE, SIG_DFL);
+        int status = run_in_process(cmd, in_fd >= 0 ? in_fd : STDIN_FILENO,
+                                    out_fd >= 0 ? out_fd : STDOUT_FILENO);
+        fflush(stdout);
+        _exit(status);
+    }
+    TRACE_END(fork_start, "fork", (long)pid);
+    if(pid < 0) printf("Fork failed\n");
+    return pid;
+}
+
+// helper to run a lone utility or file operation in the shell itself, with
+// its redirections
+static int run_utility(struct cmd_node *cmd) {
+    struct launch_io redir;
+    if(open_redirections(cmd, &redir) < 0) return 1;
+    fflush(stdout);
+
+    // a closed reader should fail the write, not kill the shell
+    void (*old_pipe)(int) = signal(SIGPIPE, SIG_IGN);
+    int status = run_in_process(cmd, redir.in_fd >= 0 ? redir.in_fd : STDIN_FILENO,
+                                redir.out_fd >= 0 ? redir.out_fd : STDOUT_FILENO);
+    signal(SIGPIPE, old_pipe);
+
+    if(redir.in_fd >= 0) close(redir.in_fd);
+    if(redir.out_fd >= 0) close(redir.out_fd);
+    return status;
+}
+
+// 13. Pipe execution, also 14. reverse pipes whose stages the parser has
+// already reordered. A redirection on a stage takes precedence over its pipe.
+// Background pipelines are registered as jobs instead of waited for.
+int pipeexec(struct line_ast *ast, struct pipe_node *pl, int background) {
+    struct cmd_node *cmds = &ast->cmds[pl->first_cmd];
+    int cmd_count = pl->cmd_count;
+    int timed = time_line && !background;
+    struct timespec start;
+    if(timed) clock_gettime(CLOCK_MONOTONIC, &start);
+    int64_t audit_start_ns = audit_enabled ? audit_now() : 0;
+
+    // builtins and file operations run in the shell itself, unless pinned
+    // or niced, which only a process of their own can be
+    int in_shell = cmd_count == 1 && (cmds[0].kind == CMD_BUILTIN
+            || ((cmds[0].kind == CMD_UTILITY || cmds[0].kind == CMD_FILEOP) && !background
+                && cmds[0].cpus == NULL && cmds[0].nice == 0));
+    if(in_shell) {
+        struct rusage before, after;
+        if(timed) getrusage(RUSAGE_SELF, &before);
+        int status;
+        if(cmds[0].kind == CMD_BUILTIN) {
+            status = run_builtin(&cmds[0]);
+        } else {
+            status = run_utility(&cmds[0]);
+            record_stages(cmds, &status, 1);
+        }
+        if(timed) {
+            struct stage_usage usage;
+            getrusage(RUSAGE_SELF, &after);
+            usage_delta(&usage.ru, &before, &after);
+            clock_gettime(CLOCK_MONOTONIC, &usage.end);
+            time_report(cmds, &usage, 1, &start);
+        }
+        if(audit_enabled && audit_start_ns != 0) {     // not the audit -f that turned it on
+            pid_t self = getpid();
+            audit_pipeline(&self, &status, 1, audit_start_ns, audit_now() - audit_start_ns);
+        }
+        return status;
+    }
+
+    // creating all pipes, close-on-exec so children only keep their dup2'd ends
+    int (*pipes)[2] = arena_alloc(&line_arena, (size_t)cmd_count * sizeof(*pipes));
+    for(int p=0; p<cmd_count-1; p++) {
+        if(pipe2(pipes[p], O_CLOEXEC) < 0) {
+            printf("Pipe creation failed\n");
+            for(int x=0; x<p; x++) {
                 close(pipes[x][0]);
                 close(pipes[x][1]);
             }
-            
-            execvp(cmds[c][0], cmds[c]);
-            exit(1);
-        } else if(fork_res < 0) {
-            printf("Fork failed\n");
-            return;
+            return 1;
+        }
+        // throughput mode: fewer, larger transfers and context switches
+        if(opt_bigpipe || pl->big_pipes) {
+            last_pipe_size = grow_pipe(pipes[p][1]);
+        } else {
+            last_pipe_size = fcntl(pipes[p][1], F_GETPIPE_SZ);
+        }
+    }
+
+    // hold SIGCHLD until our stages are waited for or registered as jobs
+    sigset_t old_mask;
+    jobs_block(&old_mask);
+
+    // stages without their own taskset get one CPU each under set -o pin
+    int pin_base = -1;
+    if(opt_pin && cmd_count > 1) {
+        pin_init();
+        if(pin_count > 0) {
+            pin_base = pin_next;
+            pin_next = (pin_next + cmd_count) % pin_count;
+        }
+    }
+
+    // Launch all stages
+    pid_t *pids = arena_alloc(&line_arena, (size_t)cmd_count * sizeof(pid_t));
+    int *statuses = arena_alloc(&line_arena, (size_t)cmd_count * sizeof(int));
+    for(int c=0; c<cmd_count; c++) {
+        struct launch_io io = { -1, -1 };
+        struct launch_io redir;
+        pids[c] = -1;
+        statuses[c] = 1;
+
+        // Connect input pipe if not first command
+        if(c > 0) {
+            io.in_fd = pipes[c-1][0];
         }
+
+        // Connect output pipe if not last command
+        if(c < cmd_count-1) {
+            io.out_fd = pipes[c][1];
+        }
+
+        if(open_redirections(&cmds[c], &redir) < 0) continue;
+        if(redir.in_fd >= 0) io.in_fd = redir.in_fd;
+        if(redir.out_fd >= 0) io.out_fd = redir.out_fd;
+
+        // the child inherits the mask the shell holds while starting it,
+        // so it runs pinned from its first instruction
+        cpu_set_t stage_cpus, shell_cpus;
+        const cpu_set_t *cpus = cmds[c].cpus;
+        if(cpus == NULL && pin_base >= 0) {
+            CPU_ZERO(&stage_cpus);
+            CPU_SET(pin_order[(pin_base + c) % pin_count], &stage_cpus);
+            cpus = &stage_cpus;
+        }
+        int pinned = cpus != NULL && sched_getaffinity(0, sizeof(shell_cpus), &shell_cpus) == 0
+                && sched_setaffinity(0, sizeof(*cpus), cpus) == 0;
+        if(cpus != NULL && !pinned) {
+            printf("Failed to pin %s: %s\n", cmds[c].argv[0], strerror(errno));
+        } else if(cmds[c].kind == CMD_UTILITY || cmds[c].kind == CMD_FILEOP) {
+            pids[c] = fork_utility(&cmds[c], io.in_fd, io.out_fd, pipes, cmd_count-1, &old_mask);
+        } else {
+            pids[c] = launch_command(cmds[c].argv, &io);
+            if(pids[c] < 0) statuses[c] = 127;
+        }
+        if(pinned) sched_setaffinity(0, sizeof(shell_cpus), &shell_cpus);
+        if(pids[c] > 0 && cmds[c].nice != 0) {
+            setpriority(PRIO_PROCESS, (id_t)pids[c], getpriority(PRIO_PROCESS, 0) + cmds[c].nice);
+        }
+
+        if(redir.in_fd >= 0) close(redir.in_fd);
+        if(redir.out_fd >= 0) close(redir.out_fd);
     }
-    
+
     // Parent process - close all pipes
     for(int p=0; p<cmd_count-1; p++) {
         close(pipes[p][0]);
         close(pipes[p][1]);
     }
-    
-    // Wait for all children
-    for(int c=0; c<cmd_count; c++) {
-        wait(NULL);
+
+    if(background) {
+        // Don't wait for background processes
+        for(int c=0; c<cmd_count; c++) {
+            if(pids[c] > 0) add_background_job(pids[c], cmds[c].argv[0], -1, cmds[c].nice);
+            if(pids[c] > 0 && audit_enabled) audit_job_started(pids[c], audit_start_ns);
+        }
+        jobs_unblock(&old_mask);
+        if(audit_enabled) audit_pipeline(pids, NULL, cmd_count, audit_start_ns, -1);
+        if(pids[cmd_count-1] > 0) {
+            printf("Background process started with PID: %d\n", pids[cmd_count-1]);
+        }
+        return 0;
+    }
+
+    // Wait for exactly our stages, then keep their statuses for pipestatus
+    struct stage_usage *usage = arena_alloc(&line_arena, (size_t)cmd_count * sizeof(*usage));
+    wait_stages(pids, statuses, usage, cmd_count);
+    jobs_unblock(&old_mask);
+
+    record_stages(cmds, statuses, cmd_count);
+    if(timed) time_report(cmds, usage, cmd_count, &start);
+    if(audit_enabled) audit_pipeline(pids, statuses, cmd_count, audit_start_ns, audit_now() - audit_start_ns);
+
+    // the last stage decides, or with pipefail the rightmost failing one
+    int status = statuses[cmd_count-1];
+    if(opt_pipefail) {
+        for(int c=0; c<cmd_count; c++) {
+            if(statuses[c] != 0) status = statuses[c];
+        }
     }
+    return status;
 }
 
-// 15. Conditional execution
-void condexec(char *tokens[], int num_tokens) {
-    // Phase 1: Parse into separate arrays for commands and operators
-    char *cmds[MAX_COMMANDS][MAX_ARGS];
-    char *ops[MAX_COMMANDS];
-    int cmd_lens[MAX_COMMANDS];
-    int cmd_count = 0;
-    int op_count = 0;
-    
-    // Count conditional operators
-    int cond_count = 0;
-    for(int i=0; i<num_tokens; i++) {
-        if(strcmp(tokens[i], "&&") == 0 || strcmp(tokens[i], "||") == 0) {
-            cond_count = cond_count + 1;
+// 15. Conditional execution: && runs the next pipeline only after success,
+// || only after failure; a skipped pipeline leaves the status unchanged
+int condexec(struct line_ast *ast, struct andor_node *andor) {
+    int status = 0;
+    for(int i = 0; i < andor->pipe_count && !exit_requested; i++) {
+        struct pipe_node *pl = &ast->pipes[andor->first_pipe + i];
+        if(i > 0) {
+            int op = ast->pipes[andor->first_pipe + i - 1].next_op;
+            if((op == TOK_AND && status != 0) || (op == TOK_OR && status == 0)) {
+                continue;
+            }
         }
+        TRACE_BEGIN(start);
+        status = pipeexec(ast, pl, 0);
+        TRACE_END(start, "pipeexec", (long)pl->cmd_count);
+        last_status = status;
     }
-    
-    // Validate max operators
-    if(cond_count > 5) {
-        printf("Maximum 5 conditional operators allowed\n");
+    return status;
+}
+
+// helper to start a list in the background. A single external pipeline is
+// launched directly; anything needing the shell's own logic runs in a forked
+// copy of the shell. Under a bglimit every job is one process, so a pipeline
+// also goes through the copy, which waits at its gate while no slot is free.
+static void run_background(struct line_ast *ast, struct andor_node *andor) {
+    struct pipe_node *pl = &ast->pipes[andor->first_pipe];
+    struct cmd_node *first = &ast->cmds[pl->first_cmd];
+    int direct = andor->pipe_count == 1 && first->kind == CMD_EXEC
+            && (bg_limit == 0 || (pl->cmd_count == 1 && bg_running < bg_limit && bg_queued == 0));
+    if(direct) {
+        TRACE_BEGIN(start);
+        pipeexec(ast, pl, 1);
+        TRACE_END(start, "pipeexec", (long)pl->cmd_count);
         return;
     }
-    
-    // Parse commands and operators
-    int start = 0;
-    for(int i=0; i<=num_tokens; i++) {
-        if(i == num_tokens || strcmp(tokens[i], "&&") == 0 || strcmp(tokens[i], "||") == 0) {
-            int cmd_len = i - start;
 
-            if(cmd_len < 1 || cmd_len > 5 || cmd_len == 0) {
-                printf("Each conditional command argc must be between 1 and 5\n");
-                return;
-            }
-            
-            // Store command
-            int j;
-            for(j=0; j<cmd_len; j++) {
-                cmds[cmd_count][j] = tokens[start + j];
-            }
-            cmds[cmd_count][cmd_len] = NULL;
-            cmd_lens[cmd_count] = cmd_len;
-            cmd_count = cmd_count + 1;
-            
-            // Store operator if exists
-            if(i < num_tokens) {
-                ops[op_count] = tokens[i];
-                op_count = op_count + 1;
-            }   
-            start = i + 1;
-        }
-    }
-    
-    // execute after checking conditions
-    for(int c=0; c<cmd_count; c++) {
-        int fork_res = fork();
-        
-        if(fork_res == 0) {
-            execvp(cmds[c][0], cmds[c]);
-            exit(1);
-        } else if(fork_res > 0) {
-            int status;
-            waitpid(fork_res, &status, 0);
-            
-            int exec_failed = 0;
-            if(WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-                exec_failed = 1;
-            }
-            
-            // Check if we should continue to next command
-            if(c < cmd_count - 1) {
-                char *op = ops[c];
-                
-                if(strcmp(op, "&&") == 0) {
-                    if(exec_failed) {
-                        return;
-                    }
-                } else if(strcmp(op, "||") == 0) {
-                    if(!exec_failed) {
-                        return;
-                    }
-                }
-            }
+    fflush(stdout);
+    sigset_t old_mask;
+    jobs_block(&old_mask);
+    int gate[2] = { -1, -1 };
+    if(bg_limit > 0 && (bg_running >= bg_limit || bg_queued > 0) && pipe2(gate, O_CLOEXEC) < 0) {
+        jobs_unblock(&old_mask);
+        printf("Pipe creation failed\n");
+        return;
+    }
+    TRACE_BEGIN(fork_start);
+    pid_t pid = fork();
+    if(pid == 0) {
+        forked_child_reset(&old_mask);
+        time_line = 0;
+        if(gate[0] >= 0) {
+            // queued: run once the shell writes to the gate, give up if it exits
+            char go;
+            ssize_t n;
+            close(gate[1]);
+            do {
+                n = read(gate[0], &go, 1);
+            } while(n < 0 && errno == EINTR);
+            if(n != 1) _exit(1);
+            close(gate[0]);
+        }
+        int status = condexec(ast, andor);
+        fflush(stdout);
+        _exit(status);
+    } else if(pid > 0) {
+        TRACE_END(fork_start, "fork", (long)pid);
+        if(gate[0] >= 0) close(gate[0]);
+        add_background_job(pid, first->argv[0], gate[1], first->nice);
+        int64_t audit_start_ns = audit_enabled ? audit_now() : 0;
+        if(audit_enabled) audit_job_started(pid, audit_start_ns);
+        jobs_unblock(&old_mask);
+        if(audit_enabled) audit_pipeline(&pid, NULL, 1, audit_start_ns, -1);
+        if(gate[1] >= 0) {
+            printf("Background job queued with PID: %d\n", pid);
         } else {
-            printf("Fork failed\n");
-            return;
+            printf("Background process started with PID: %d\n", pid);
+        }
+    } else {
+        if(gate[0] >= 0) {
+            close(gate[0]);
+            close(gate[1]);
         }
+        jobs_unblock(&old_mask);
+        printf("Fork failed\n");
     }
 }
 
-/* ======Main Function====== */
-int main(int num_args, char *arguments[]) {
+// one list of a ::: group while it runs
+struct par_member {
+    pid_t pid;
+    int fd;             // read end of the list's stdout, -1 once drained
+    char *buf;          // output not yet ended by a newline
+    size_t len;
+    size_t cap;
+    int status;
+    struct stage_usage usage;   // from wait4, for a time prefix
+};
+
+// helper to start list first+i of a ::: group in a forked copy of the
+// shell with its stdout on a fresh pipe. Returns -1 if it could not start.
+static int par_start(struct line_ast *ast, int list, struct par_member *m, const sigset_t *old_mask) {
+    int fds[2];
+    if(pipe2(fds, O_CLOEXEC) < 0) {
+        printf("Pipe creation failed\n");
+        return -1;
+    }
+    fflush(stdout);
+    TRACE_BEGIN(fork_start);
+    pid_t pid = fork();
+    if(pid == 0) {
+        forked_child_reset(old_mask);
+        time_line = 0;
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        int status = condexec(ast, &ast->andors[list]);
+        fflush(stdout);
+        _exit(status);
+    }
+    TRACE_END(fork_start, "fork", (long)pid);
+    close(fds[1]);
+    if(pid < 0) {
+        close(fds[0]);
+        printf("Fork failed\n");
+        return -1;
+    }
+    m->pid = pid;
+    m->fd = fds[0];
+    return 0;
+}
 
-    // Argument validation
-    if (num_args != 1) {
-        printf("No Arguments needed\n");
-        return 1;
+// helper to read what a member wrote and pass on its complete lines. At
+// EOF the rest goes out as is. Returns 0 once the member's pipe is drained.
+static int par_relay(struct par_member *m) {
+    if(m->cap - m->len < 4096) {
+        size_t cap = m->cap ? m->cap * 2 : 8192;
+        char *buf = realloc(m->buf, cap);
+        if(buf != NULL) {
+            m->buf = buf;
+            m->cap = cap;
+        }
     }
 
-    // token size and array for tokens
-    char input[MAX_INPUT_SIZE];
-    char *tokens[MAX_ARGS];
+    ssize_t n = m->cap > m->len ? read(m->fd, m->buf + m->len, m->cap - m->len) : 0;
+    if(n < 0 && errno == EINTR) return 1;
+    if(n <= 0) {
+        write_all(STDOUT_FILENO, m->buf, m->len);
+        m->len = 0;
+        return 0;
+    }
+    m->len += (size_t)n;
+
+    // one write per batch of whole lines keeps other members' lines out
+    char *nl = memrchr(m->buf, '\n', m->len);
+    if(nl != NULL) {
+        size_t whole = (size_t)(nl - m->buf) + 1;
+        write_all(STDOUT_FILENO, m->buf, whole);
+        memmove(m->buf, m->buf + whole, m->len - whole);
+        m->len -= whole;
+    }
+    return 1;
+}
 
-    while (1) {
-        printf("f25shell$: ");
-        if (fgets(input, sizeof(input), stdin) == NULL) {
-            // EOF or read error
-            printf("\n");
+// 24. Parallel execution: count lists joined by ::: run at the same time,
+// at most parallel_limit() at once, each in a forked copy of the shell.
+// Their stdout is relayed a whole line at a time so lines never interleave.
+// Returns the status of the rightmost failing list, 0 if all succeeded.
+int parexec(struct line_ast *ast, int first, int count) {
+    int limit = parallel_limit();
+    if(limit > count) limit = count;
+    struct par_member *members = arena_alloc(&line_arena, (size_t)count * sizeof(*members));
+    struct pollfd *fds = arena_alloc(&line_arena, (size_t)limit * sizeof(*fds));
+    int *slot = arena_alloc(&line_arena, (size_t)limit * sizeof(*slot));
+    memset(members, 0, (size_t)count * sizeof(*members));
+    int64_t audit_start_ns = audit_enabled ? audit_now() : 0;
+    struct timespec start;
+    if(time_line) clock_gettime(CLOCK_MONOTONIC, &start);
+
+    fflush(stdout);
+    sigset_t old_mask;
+    jobs_block(&old_mask);
+
+    int next = 0;
+    int running = 0;
+    int done = 0;
+    while(done < count) {
+        // top the pool up
+        while(running < limit && next < count) {
+            struct par_member *m = &members[next];
+            if(par_start(ast, first + next, m, &old_mask) < 0) {
+                m->fd = -1;
+                m->status = 1;
+                clock_gettime(CLOCK_MONOTONIC, &m->usage.end);
+                done = done + 1;
+            } else {
+                running = running + 1;
+            }
+            next = next + 1;
+        }
+        if(running == 0) continue;
+
+        int nfds = 0;
+        for(int i = 0; i < next; i++) {
+            if(members[i].fd < 0) continue;
+            fds[nfds].fd = members[i].fd;
+            fds[nfds].events = POLLIN;
+            slot[nfds++] = i;
+        }
+        if(poll(fds, (nfds_t)nfds, -1) < 0) {
+            if(errno == EINTR) continue;
             break;
         }
-
-        // Remove trailing newline
-        int length = strlen(input);
-        if (length > 0 && input[length - 1] == '\n') {
-            input[length - 1] = '\0';
+        for(int p = 0; p < nfds; p++) {
+            if(fds[p].revents == 0) continue;
+            struct par_member *m = &members[slot[p]];
+            if(par_relay(m)) continue;
+
+            // output done: the list has exited or is about to
+            close(m->fd);
+            m->fd = -1;
+            // wait4 also gives the rusage of the list and what it reaped
+            int status;
+            m->status = wait4(m->pid, &status, 0, &m->usage.ru) > 0 ? exit_status(status) : 1;
+            clock_gettime(CLOCK_MONOTONIC, &m->usage.end);
+            free(m->buf);
+            running = running - 1;
+            done = done + 1;
         }
+    }
+    jobs_unblock(&old_mask);
+
+    // pipestatus shows one entry per list, named after its first command
+    struct cmd_node *names = arena_alloc(&line_arena, (size_t)count * sizeof(*names));
+    int *statuses = arena_alloc(&line_arena, (size_t)count * sizeof(*statuses));
+    pid_t *pids = arena_alloc(&line_arena, (size_t)count * sizeof(*pids));
+    int result = 0;
+    for(int i = 0; i < count; i++) {
+        names[i] = ast->cmds[ast->pipes[ast->andors[first + i].first_pipe].first_cmd];
+        statuses[i] = members[i].status;
+        pids[i] = members[i].pid;
+        if(statuses[i] != 0) result = statuses[i];
+    }
+    record_stages(names, statuses, count);
+    if(time_line) {
+        struct stage_usage *usage = arena_alloc(&line_arena, (size_t)count * sizeof(*usage));
+        for(int i = 0; i < count; i++) usage[i] = members[i].usage;
+        time_report(names, usage, count, &start);
+    }
+    if(audit_enabled) audit_pipeline(pids, statuses, count, audit_start_ns, audit_now() - audit_start_ns);
+    return result;
+}
 
-        // Tokenize input first
-        int num_tokens = 0;
-        char *token = strtok(input, " ");
-        while (token != NULL && num_tokens < MAX_ARGS - 1) {
-            tokens[num_tokens++] = token;
-            token = strtok(NULL, " ");
+// 12. Sequential execution of the lists on a line
+int seqexec(struct line_ast *ast) {
+    int status = 0;
+    for(int i = 0; i < ast->andor_count && !exit_requested; i++) {
+        struct andor_node *andor = &ast->andors[i];
+        if(andor->background) {
+            run_background(ast, andor);
+            status = 0;
+            last_status = 0;
+            continue;
         }
 
-        // execvp needs NULL termination
-        tokens[num_tokens] = NULL;
-
-        if (num_tokens == 0) continue; // empty input: prompt again checking again
-
-        int command_matched = 0;
-        // Array of valid commands
-        const char *commands[] = {
-            "killterm", "killallterms", "numbg", "killbp", "exit"
-        };
+        // a ::: group runs as a whole and then counts as one list
+        if(andor->parallel) {
+            int count = 1;
+            while(ast->andors[i + count - 1].parallel) count = count + 1;
+            TRACE_BEGIN(start);
+            status = parexec(ast, i, count);
+            TRACE_END(start, "parexec", (long)count);
+            last_status = status;
+            i = i + count - 1;
+            if(status != 0 && i < ast->andor_count - 1) {
+                printf("Command execution failed, stopping sequential execution\n");
+                break;
+            }
+            continue;
+        }
 
-        for (int i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
-            if (strcmp(tokens[0], commands[i]) == 0) {
-                command_matched = 1;
-                if (num_tokens != 1) {
-                        printf("Few/many arguments received\n");
-                        break;
-                }
-                switch (i + 1) {
-                case 1: // 1. Kill current terminal - killterm
-                    handle_killterm(); break;
+        TRACE_BEGIN(start);
+        status = condexec(ast, andor);
+        TRACE_END(start, "condexec", (long)andor->pipe_count);
 
-                case 2: // 2. Kill all terminals - killallterms
-                    handle_killallterms(); break;
+        // Command not found or failed - stop the rest of the line
+        if(status != 0 && i < ast->andor_count - 1) {
+            printf("Command execution failed, stopping sequential execution\n");
+            break;
+        }
+    }
+    return status;
+}
 
-                case 3: // 3. Count bg processes - numbg
-                    count_bg_processes(); break;
+// helper to run one input line of len bytes, which must live in the line
+// arena; returns 1 when the shell should exit
+int execute_line(char *input, size_t len) {
+    struct line_ast ast;
+    audit_line_no = audit_line_no + 1;
+    if(audit_enabled) {
+        // parsing splits the line in place, so keep the text first
+        size_t keep = len < AUDIT_TEXT_SIZE - 1 ? len : AUDIT_TEXT_SIZE - 1;
+        memcpy(audit_text, input, keep);
+        audit_text[keep] = '\0';
+    }
+    TRACE_BEGIN(parse_start);
+    int parsed = parse_line(input, len, &ast);
+    TRACE_END(parse_start, "parse", (long)len);
+    if(parsed < 0) {
+        last_status = 2;    // syntax error, as in sh
+        return 0;
+    }
+    if(!ast.timed) {
+        TRACE_BEGIN(start);
+        seqexec(&ast);
+        TRACE_END(start, "seqexec", (long)ast.andor_count);
+        if(audit_enabled) audit_jobs();
+        return exit_requested;
+    }
 
-                case 4: // 4. kill all process other than current and bash - killbp
-                    kill_all_processes(); break;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&time_line_usage, 0, sizeof(time_line_usage));
+    time_line_pipes = 0;
+    time_line = 1;
+    seqexec(&ast);
+    time_line = 0;
+    if(time_line_pipes > 1) usage_print("total", elapsed_since(&start, NULL), &time_line_usage);
+    if(audit_enabled) audit_jobs();
+    return exit_requested;
+}
 
-                case 5: // 5. Exit
-                    return 0; 
 
-                }
-                break;
+/* ======Input====== */
+
+// Lines come either from a mapped script (the whole file is one buffer) or
+// from a descriptor read in large blocks, so batch input costs one syscall
+// per block instead of one per line. The block buffer grows to hold a line
+// longer than itself, so there is no limit on line length.
+struct line_reader {
+    int fd;             // -1 when buf holds a mapped script or -c argument
+    char *buf;
+    size_t cap;         // size of buf, grown as needed when reading fd
+    size_t len;         // bytes valid in buf
+    size_t pos;         // start of the next unread line
+    int eof;
+};
+
+// helper to copy the next line into the line arena without its newline.
+// Returns the line and stores its length in *len, or NULL at EOF.
+char *read_line(struct line_reader *reader, size_t *len) {
+    while(1) {
+        char *start = reader->buf + reader->pos;
+        size_t avail = reader->len - reader->pos;
+        char *nl = memchr(start, '\n', avail);
+
+        // a full line, or the unterminated last line once input is done
+        if(nl != NULL || (reader->eof && avail > 0)) {
+            size_t line_len = nl ? (size_t)(nl - start) : avail;
+            reader->pos += line_len + (nl ? 1 : 0);
+            char *line = arena_alloc(&line_arena, line_len + 1);
+            memcpy(line, start, line_len);
+            line[line_len] = '\0';
+            *len = line_len;
+            return line;
+        }
+        if(reader->eof) return NULL;
+
+        // move the partial line to the front and refill behind it
+        memmove(reader->buf, start, avail);
+        reader->len = avail;
+        reader->pos = 0;
+        if(reader->len == reader->cap) {
+            // no newline in a full buffer: make room for the rest of the line
+            char *bigger = realloc(reader->buf, reader->cap * 2);
+            if(bigger == NULL) {
+                printf("Out of memory\n");
+                return NULL;
             }
+            reader->buf = bigger;
+            reader->cap = reader->cap * 2;
+        }
+        ssize_t n = read(reader->fd, reader->buf + reader->len, reader->cap - reader->len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) {
+            reader->eof = 1;
+        } else {
+            reader->len += (size_t)n;
         }
+    }
+}
 
-        if (!command_matched) {
-            int has_file_op = 0;
-            
-            // Check for # operator
-            if(strcmp(tokens[0], "#") == 0) {
-                has_file_op = 1;
-                check_file_ops(tokens, num_tokens);
-                continue;
-            }
-            
-            // Check for ++ or +
-            for(int i=0; i<num_tokens; i++) {
-                if(strcmp(tokens[i], "++") == 0 || strcmp(tokens[i], "+") == 0) {
-                    has_file_op = 1;
-                    check_file_ops(tokens, num_tokens);
-                    break;
-                }
-            }
-            
-            if(has_file_op) continue;
-            
-            int has_redir = 0;
-            
-            // Check for >> before >
-            for(int i=0; i<num_tokens; i++) {
-                if(strcmp(tokens[i], ">>") == 0) {
-                    has_redir = 1;
-                    redir_append(tokens, num_tokens);
-                    break;
-                }
-            }
-            if(has_redir) continue;
-            
-            // Check for > operator
-            for(int i=0; i<num_tokens; i++) {
-                if(strcmp(tokens[i], ">") == 0) {
-                    has_redir = 1;
-                    redir_out(tokens, num_tokens);
-                    break;
-                }
-            }
-            if(has_redir) continue;
-            
-            // Check for < operator
-            for(int i=0; i<num_tokens; i++) {
-                if(strcmp(tokens[i], "<") == 0) {
-                    has_redir = 1;
-                    redir_in(tokens, num_tokens);
-                    break;
-                }
-            }
-            if(has_redir) continue;
-            
-            // Check for conditional execution
-            int has_cond = 0;
-            for(int i=0; i<num_tokens; i++) {
-                if(strcmp(tokens[i], "&&") == 0 || strcmp(tokens[i], "||") == 0) {
-                    has_cond = 1;
-                    condexec(tokens, num_tokens);
-                    break;
-                }
-            }
-            if(has_cond) continue;
-            
-            // Check for reverse pipe
-            int has_revpipe = 0;
-            for(int i=0; i<num_tokens; i++) {
-                if(strcmp(tokens[i], "~") == 0) {
-                    has_revpipe = 1;
-                    revpipe(tokens, num_tokens);
-                    break;
-                }
-            }
-            if(has_revpipe) continue;
-            
-            // Check for normal pipe
-            int has_pipe = 0;
-            for(int i=0; i<num_tokens; i++) {
-                if(strcmp(tokens[i], "|") == 0) {
-                    has_pipe = 1;
-                    pipeexec(tokens, num_tokens);
-                    break;
-                }
-            }
-            if(has_pipe) continue;
-            
-            // Check for sequential execution
-            int has_semi = 0;
-            for(int i=0; i<num_tokens; i++) {
-                if(strcmp(tokens[i], ";") == 0) {
-                    has_semi = 1;
-                    seqexec(tokens, num_tokens);
-                    break;
-                }
-            }
-            if(has_semi) continue;
-            
-            // Check if it's a background process (ends with "&")
-            int is_background = 0;
-            if (num_tokens > 0 && strcmp(tokens[num_tokens - 1], "&") == 0) {
-                tokens[num_tokens - 1] = NULL;
-                num_tokens = num_tokens - 1;
-                is_background = 1;
-            }
-            
-            int pid = fork();
-            if (pid == 0) {
-                execvp(tokens[0], tokens);
-                // if this line executes means execvp failed
-                printf("Exec failed for %s\n", tokens[0]);
-                exit(1);
-            } else if (pid > 0) {
-                if (is_background) {
-                    // Don't wait for background processes
-                    printf("Background process started with PID: %d\n", pid);
-                    add_background_job(pid);
-                } else {
-                    // wait for foreground process to finish
-                    wait(NULL);
-                }
-            } else {
-                printf("Fork failed\n");
-            }
+// helper to set reader up for block reads from fd
+static int reader_open(struct line_reader *reader, int fd) {
+    reader->fd = fd;
+    reader->buf = malloc(INPUT_BLOCK_SIZE);
+    reader->cap = INPUT_BLOCK_SIZE;
+    reader->len = 0;
+    reader->pos = 0;
+    reader->eof = 0;
+    if(reader->buf == NULL) {
+        printf("Out of memory\n");
+        return -1;
+    }
+    return 0;
+}
+
+// helper to run every line from reader, prompting only when interactive.
+// Returns the status of the last pipeline run.
+int run_input(struct line_reader *reader, int interactive) {
+    while(1) {
+        // the previous line and everything parsed from it are done with
+        arena_reset(&line_arena);
+        if(interactive) {
+            printf("f25shell$: ");
+            fflush(stdout);
+        }
+        size_t len;
+        char *input = read_line(reader, &len);
+        if(input == NULL) {
+            // EOF or read error
+            if(interactive) printf("\n");
+            return last_status;
         }
+        if(execute_line(input, len)) return last_status;
+    }
+}
+
+// helper to run a script file, mapped when possible
+int run_script(const char *filename) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        printf("Failed to open file %s\n", filename);
+        return 1;
+    }
+    struct line_reader reader;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    int result = 1;
+    if(map != MAP_FAILED) {
+        madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+        reader = (struct line_reader){ -1, map, (size_t)st.st_size, (size_t)st.st_size, 0, 1 };
+        result = run_input(&reader, 0);
+        munmap(map, (size_t)st.st_size);
+    } else if(reader_open(&reader, fd) == 0) {
+        result = run_input(&reader, 0);
+        free(reader.buf);
+    }
+    close(fd);
+    return result;
+}
+
+/* ======Main Function====== */
+int main(int num_args, char *arguments[]) {
+
+    // background jobs are reaped as soon as they exit
+    jobs_init();
+
+    // let killallterms in other shells find this one
+    registry_register();
+
+    // F25SHELL_AUDIT names a file to log every pipeline to from the start
+    const char *audit_file = getenv("F25SHELL_AUDIT");
+    if(audit_file != NULL && audit_file[0] != '\0') audit_start(audit_file);
+
+    // -c runs its argument as input lines, one more argument names a script
+    if (num_args == 3 && strcmp(arguments[1], "-c") == 0) {
+        size_t len = strlen(arguments[2]);
+        struct line_reader reader = { -1, arguments[2], len, len, 0, 1 };
+        return run_input(&reader, 0);
+    }
+    if (num_args == 2 && arguments[1][0] != '-') {
+        return run_script(arguments[1]);
     }
+    if (num_args != 1) {
+        printf("Usage: f25shell [-c command | script]\n");
+        return 1;
+    }
+
+    // Prompt only for a terminal so piped input produces clean output
+    struct line_reader reader;
+    if(reader_open(&reader, STDIN_FILENO) < 0) return 1;
+    return run_input(&reader, isatty(STDIN_FILENO));
 }